@@ -0,0 +1,386 @@
+#include "Analyzer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+const uint32_t CACHE_MAGIC = 0x4E413843; // "C8AN"
+const uint32_t CACHE_VERSION = 2;
+
+uint64_t Analyzer::hashROM(const uint8_t* rom, uint16_t size)
+{
+	// 64-bit FNV-1a
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (uint16_t i = 0; i < size; ++i)
+	{
+		hash ^= rom[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+void Analyzer::analyze(const Chip8& chip8, const std::string& cacheDir)
+{
+	romSize = chip8.romSize;
+	romHash = hashROM(chip8.memory + PROGRAM_START_ADDRESS, romSize);
+	uint16_t romEnd = PROGRAM_START_ADDRESS + romSize;
+
+	char fileName[32];
+	snprintf(fileName, sizeof(fileName), "/%016llx.bin", static_cast<unsigned long long>(romHash));
+	std::string cachePath = cacheDir + fileName;
+
+	bool useCache = !cacheDir.empty();
+	if (!useCache || !loadCache(cachePath))
+	{
+		memset(byteType, BYTE_UNKNOWN, sizeof(byteType));
+		memset(isLeader, 0, sizeof(isLeader));
+		blocks.clear();
+		calls.clear();
+
+		traverse(chip8.memory, romEnd);
+		buildBlocks(chip8.memory, romEnd);
+
+		for (uint16_t address = PROGRAM_START_ADDRESS; address < romEnd; ++address)
+		{
+			if (byteType[address] == BYTE_UNKNOWN)
+			{
+				byteType[address] = BYTE_DATA;
+			}
+		}
+
+		if (useCache)
+		{
+			saveCache(cachePath);
+		}
+	}
+
+	std::fill(blockIndex, blockIndex + MEMORY_SIZE, -1);
+	for (size_t i = 0; i < blocks.size(); ++i)
+	{
+		blockIndex[blocks[i].start] = static_cast<int16_t>(i);
+	}
+
+	subroutines.clear();
+	for (const CallEdge& call : calls)
+	{
+		subroutines.push_back(call.target);
+	}
+	std::sort(subroutines.begin(), subroutines.end());
+	subroutines.erase(std::unique(subroutines.begin(), subroutines.end()), subroutines.end());
+
+	buildListing(romEnd);
+}
+
+int Analyzer::blockAt(uint16_t address) const
+{
+	return blockIndex[address & (MEMORY_SIZE - 1)];
+}
+
+uint16_t Analyzer::codeSize() const
+{
+	uint16_t size = 0;
+	for (const BasicBlock& block : blocks)
+	{
+		size += block.end - block.start;
+	}
+	return size;
+}
+
+void Analyzer::traverse(const uint8_t* memory, uint16_t romEnd)
+{
+	std::vector<uint16_t> worklist;
+
+	auto addTarget = [&](uint16_t target)
+	{
+		// Only the ROM's own bytes are analyzed, transfers elsewhere are left to the interpreter
+		if (target >= PROGRAM_START_ADDRESS && target + 1u < romEnd && !isLeader[target])
+		{
+			isLeader[target] = true;
+			worklist.push_back(target);
+		}
+	};
+
+	addTarget(PROGRAM_START_ADDRESS);
+
+	while (!worklist.empty())
+	{
+		uint16_t address = worklist.back();
+		worklist.pop_back();
+
+		bool fallsThrough = true;
+		while (fallsThrough && address + 1u < romEnd && byteType[address] != BYTE_CODE_START)
+		{
+			byteType[address] = BYTE_CODE_START;
+			byteType[address + 1] = BYTE_CODE;
+
+			uint16_t opcode = memory[address] << 8u | memory[address + 1];
+			uint16_t next = address + 2;
+			uint16_t NNN = opcode & 0x0FFFu;
+
+			switch (opcode & 0xF000u)
+			{
+			case 0x0000u:
+				// execute() runs any 0x0XX0 as OP_00E0 and any 0x0XXE as OP_00EE, anything else is invalid
+				fallsThrough = (opcode & 0x000Fu) == 0x0u;
+				break;
+			case 0x1000u:
+				addTarget(NNN);
+				fallsThrough = false;
+				break;
+			case 0x2000u:
+			{
+				CallEdge call;
+				call.caller = address;
+				call.target = NNN;
+				calls.push_back(call);
+				addTarget(NNN);
+				addTarget(next);
+				fallsThrough = false;
+				break;
+			}
+			case 0x3000u:
+			case 0x4000u:
+			case 0x5000u:
+			case 0x9000u:
+				addTarget(next);
+				addTarget(next + 2);
+				fallsThrough = false;
+				break;
+			case 0xB000u:
+				fallsThrough = false;
+				break;
+			case 0xE000u:
+				if ((opcode & 0x00FFu) == 0x009Eu || (opcode & 0x00FFu) == 0x00A1u)
+				{
+					addTarget(next);
+					addTarget(next + 2);
+				}
+				fallsThrough = false;
+				break;
+			default:
+				break;
+			}
+
+			address = next;
+		}
+	}
+}
+
+void Analyzer::buildBlocks(const uint8_t* memory, uint16_t romEnd)
+{
+	for (uint16_t start = PROGRAM_START_ADDRESS; start < romEnd; ++start)
+	{
+		if (!isLeader[start] || byteType[start] != BYTE_CODE_START)
+		{
+			continue;
+		}
+
+		BasicBlock block;
+		block.start = start;
+
+		uint16_t address = start;
+		while (true)
+		{
+			uint16_t opcode = memory[address] << 8u | memory[address + 1];
+			uint16_t next = address + 2;
+			block.end = next;
+
+			bool isSkip = false;
+			switch (opcode & 0xF000u)
+			{
+			case 0x3000u:
+			case 0x4000u:
+			case 0x5000u:
+			case 0x9000u:
+				isSkip = true;
+				break;
+			case 0xE000u:
+				isSkip = (opcode & 0x00FFu) == 0x009Eu || (opcode & 0x00FFu) == 0x00A1u;
+				break;
+			default:
+				break;
+			}
+
+			if (isSkip)
+			{
+				block.successors[block.successorCount++] = next;
+				block.successors[block.successorCount++] = next + 2;
+				break;
+			}
+			if ((opcode & 0xF000u) == 0x1000u)
+			{
+				block.successors[block.successorCount++] = opcode & 0x0FFFu;
+				break;
+			}
+			if ((opcode & 0xF000u) == 0x2000u)
+			{
+				block.successors[block.successorCount++] = opcode & 0x0FFFu;
+				block.successors[block.successorCount++] = next;
+				break;
+			}
+			if ((opcode & 0xF000u) == 0xB000u)
+			{
+				block.dynamicExit = true;
+				break;
+			}
+			if ((opcode & 0xF00Fu) == 0x000Eu)
+			{
+				block.returns = true;
+				break;
+			}
+			if ((opcode & 0xF000u) == 0x0000u && (opcode & 0x000Fu) != 0x0u)
+			{
+				// Invalid opcode, most likely data reached by a bad guess
+				break;
+			}
+			if (next + 1u >= romEnd || byteType[next] != BYTE_CODE_START)
+			{
+				break;
+			}
+			if (isLeader[next])
+			{
+				block.successors[block.successorCount++] = next;
+				break;
+			}
+
+			address = next;
+		}
+
+		blocks.push_back(block);
+	}
+}
+
+void Analyzer::buildListing(uint16_t romEnd)
+{
+	listing.clear();
+	std::fill(listingIndex, listingIndex + MEMORY_SIZE, -1);
+
+	uint16_t address = PROGRAM_START_ADDRESS;
+	while (address < romEnd)
+	{
+		listingIndex[address] = static_cast<int16_t>(listing.size());
+		listing.push_back(address);
+
+		// Instructions take two bytes, data is grouped into words unless code starts in between
+		if (byteType[address] == BYTE_CODE_START || (address + 1u < romEnd && byteType[address + 1] != BYTE_CODE_START))
+		{
+			address += 2;
+		}
+		else
+		{
+			address += 1;
+		}
+	}
+}
+
+bool Analyzer::loadCache(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+	{
+		return false;
+	}
+	uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+	file.seekg(0);
+
+	uint32_t magic = 0, version = 0, blockCount = 0, callCount = 0;
+	uint16_t cachedSize = 0;
+	file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	file.read(reinterpret_cast<char*>(&version), sizeof(version));
+	file.read(reinterpret_cast<char*>(&cachedSize), sizeof(cachedSize));
+	if (!file || magic != CACHE_MAGIC || version != CACHE_VERSION || cachedSize != romSize)
+	{
+		return false;
+	}
+
+	// Counts are checked against the bytes left in the file before anything is allocated
+	uint64_t remaining = fileSize - static_cast<uint64_t>(file.tellg());
+	file.read(reinterpret_cast<char*>(byteType), sizeof(byteType));
+	file.read(reinterpret_cast<char*>(&blockCount), sizeof(blockCount));
+	remaining -= std::min<uint64_t>(remaining, sizeof(byteType) + sizeof(blockCount));
+	if (!file || blockCount > MEMORY_SIZE || blockCount * sizeof(BasicBlock) > remaining)
+	{
+		return false;
+	}
+	blocks.resize(blockCount);
+	file.read(reinterpret_cast<char*>(blocks.data()), blockCount * sizeof(BasicBlock));
+
+	file.read(reinterpret_cast<char*>(&callCount), sizeof(callCount));
+	remaining -= std::min<uint64_t>(remaining, blockCount * sizeof(BasicBlock) + sizeof(callCount));
+	if (!file || callCount > MEMORY_SIZE || callCount * sizeof(CallEdge) != remaining)
+	{
+		return false;
+	}
+	calls.resize(callCount);
+	file.read(reinterpret_cast<char*>(calls.data()), callCount * sizeof(CallEdge));
+	if (!file)
+	{
+		return false;
+	}
+
+	// A corrupt or foreign cache must not index past memory, so reject it and let analyze() start over
+	for (unsigned int i = 0; i < MEMORY_SIZE; ++i)
+	{
+		if (byteType[i] > BYTE_DATA)
+		{
+			return false;
+		}
+	}
+	for (const BasicBlock& block : blocks)
+	{
+		if (block.start >= MEMORY_SIZE || block.end > MEMORY_SIZE || block.end <= block.start || block.successorCount > 2)
+		{
+			return false;
+		}
+		for (uint8_t i = 0; i < block.successorCount; ++i)
+		{
+			if (block.successors[i] >= MEMORY_SIZE)
+			{
+				return false;
+			}
+		}
+	}
+	for (const CallEdge& call : calls)
+	{
+		if (call.caller >= MEMORY_SIZE || call.target >= MEMORY_SIZE)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Analyzer::saveCache(const std::string& path) const
+{
+	std::string dir = path.substr(0, path.find_last_of('/'));
+#ifdef _WIN32
+	_mkdir(dir.c_str());
+#else
+	mkdir(dir.c_str(), 0755);
+#endif
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Warning: Failed to write analysis cache: " << path << std::endl;
+		return;
+	}
+
+	uint32_t blockCount = static_cast<uint32_t>(blocks.size());
+	uint32_t callCount = static_cast<uint32_t>(calls.size());
+	file.write(reinterpret_cast<const char*>(&CACHE_MAGIC), sizeof(CACHE_MAGIC));
+	file.write(reinterpret_cast<const char*>(&CACHE_VERSION), sizeof(CACHE_VERSION));
+	file.write(reinterpret_cast<const char*>(&romSize), sizeof(romSize));
+	file.write(reinterpret_cast<const char*>(byteType), sizeof(byteType));
+	file.write(reinterpret_cast<const char*>(&blockCount), sizeof(blockCount));
+	file.write(reinterpret_cast<const char*>(blocks.data()), blockCount * sizeof(BasicBlock));
+	file.write(reinterpret_cast<const char*>(&callCount), sizeof(callCount));
+	file.write(reinterpret_cast<const char*>(calls.data()), callCount * sizeof(CallEdge));
+}
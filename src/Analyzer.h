@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Chip8.h"
+
+// Classification of every byte in memory after analysis
+enum ByteType : uint8_t
+{
+	BYTE_UNKNOWN = 0,
+	BYTE_CODE_START = 1, // First byte of a reachable instruction
+	BYTE_CODE = 2,       // Second byte of a reachable instruction
+	BYTE_DATA = 3        // Part of the ROM never reached as code
+};
+
+struct BasicBlock
+{
+	uint16_t start{};          // Address of the first instruction
+	uint16_t end{};            // Address one past the last instruction
+	uint16_t successors[2]{};  // Statically known successors
+	uint8_t successorCount{};
+	bool dynamicExit{};        // Ends in OP_BNNN, so the target is only known at runtime
+	bool returns{};            // Ends in OP_00EE
+};
+
+struct CallEdge
+{
+	uint16_t caller{};  // Address of the OP_2NNN instruction
+	uint16_t target{};  // Subroutine entry point
+};
+
+// Static control-flow analysis of a loaded ROM: recovers code vs. data,
+// basic blocks and the call graph by following every statically known
+// transfer starting at PROGRAM_START_ADDRESS.
+class Analyzer
+{
+public:
+	// Analyzes the ROM currently in memory, reusing the result cached under cacheDir when the ROM hash matches.
+	// An empty cacheDir analyzes from scratch and writes nothing.
+	void analyze(const Chip8& chip8, const std::string& cacheDir);
+
+	// Index into blocks of the block starting at address, or -1
+	int blockAt(uint16_t address) const;
+	uint16_t codeSize() const;
+
+	static uint64_t hashROM(const uint8_t* rom, uint16_t size);
+private:
+	void traverse(const uint8_t* memory, uint16_t romEnd);
+	void buildBlocks(const uint8_t* memory, uint16_t romEnd);
+	void buildListing(uint16_t romEnd);
+	bool loadCache(const std::string& path);
+	void saveCache(const std::string& path) const;
+public:
+	uint64_t romHash{};
+	uint16_t romSize{};
+	uint8_t byteType[MEMORY_SIZE]{};
+	std::vector<BasicBlock> blocks;
+	std::vector<CallEdge> calls;
+	std::vector<uint16_t> subroutines;
+
+	// Addresses of the lines shown by the disassembly view (instructions and data words)
+	std::vector<uint16_t> listing;
+	// Index into listing for every address, or -1 for the second byte of a line
+	int16_t listingIndex[MEMORY_SIZE]{};
+private:
+	int16_t blockIndex[MEMORY_SIZE]{};
+	bool isLeader[MEMORY_SIZE]{};
+};
@@ -0,0 +1,102 @@
+#include "AotModule.h"
+
+#include <cstring>
+#include <iostream>
+#include <dlfcn.h>
+
+#include "Analyzer.h"
+
+AotModule::~AotModule()
+{
+	if (handle)
+	{
+		dlclose(handle);
+	}
+}
+
+bool AotModule::load(const char* fileName, Chip8& chip8)
+{
+	unload(chip8);
+
+	void* library = dlopen(fileName, RTLD_NOW | RTLD_LOCAL);
+	if (!library)
+	{
+		std::cerr << "Error: Failed to load compiled ROM: " << dlerror() << std::endl;
+		return false;
+	}
+
+	const uint32_t* abiVersion = static_cast<const uint32_t*>(dlsym(library, "chip8AotAbiVersion"));
+	const uint32_t* chip8Size = static_cast<const uint32_t*>(dlsym(library, "chip8AotChip8Size"));
+	const uint64_t* hash = static_cast<const uint64_t*>(dlsym(library, "chip8AotRomHash"));
+	const uint32_t* count = static_cast<const uint32_t*>(dlsym(library, "chip8AotBlockCount"));
+	const AotBlock* blocks = static_cast<const AotBlock*>(dlsym(library, "chip8AotBlocks"));
+	if (!abiVersion || !chip8Size || !hash || !count || (*count && !blocks))
+	{
+		std::cerr << "Error: Not a compiled ROM: " << fileName << std::endl;
+		dlclose(library);
+		return false;
+	}
+
+	if (*abiVersion != AOT_ABI_VERSION || *chip8Size != sizeof(Chip8))
+	{
+		std::cerr << "Error: Compiled ROM was built for a different emulator version: " << fileName << std::endl;
+		dlclose(library);
+		return false;
+	}
+
+	if (*hash != Analyzer::hashROM(chip8.memory + PROGRAM_START_ADDRESS, chip8.romSize))
+	{
+		std::cerr << "Error: Compiled ROM does not match the loaded ROM: " << fileName << std::endl;
+		dlclose(library);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < *count; ++i)
+	{
+		const AotBlock& block = blocks[i];
+		blockFunctions[block.address & (MEMORY_SIZE - 1)] = block.function;
+		blockLengths[block.address & (MEMORY_SIZE - 1)] = block.length;
+		for (unsigned int offset = 0; offset < 2u * block.length; ++offset)
+		{
+			compiledBytes[(block.address + offset) & (MEMORY_SIZE - 1)] = 1;
+		}
+	}
+
+	handle = library;
+	blockCount = *count;
+	romHash = *hash;
+
+	// Writes to compiled bytes disable the module, the interpreter sees the new code
+	chip8.codeWatch = compiledBytes;
+	chip8.codeModified = false;
+
+	std::cout << "Loaded " << blockCount << " compiled blocks from " << fileName << std::endl;
+	return true;
+}
+
+void AotModule::unload(Chip8& chip8)
+{
+	if (!handle)
+	{
+		return;
+	}
+
+	if (chip8.codeWatch == compiledBytes)
+	{
+		chip8.codeWatch = nullptr;
+		chip8.codeModified = false;
+	}
+
+	dlclose(handle);
+	handle = nullptr;
+	blockCount = 0;
+	romHash = 0;
+	memset(blockFunctions, 0, sizeof(blockFunctions));
+	memset(compiledBytes, 0, sizeof(compiledBytes));
+	memset(blockLengths, 0, sizeof(blockLengths));
+}
+
+void AotModule::executeOpcode(Chip8& chip8, uint16_t opcode)
+{
+	chip8.executeOpcode(opcode);
+}
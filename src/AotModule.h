@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Chip8.h"
+
+// Bumped whenever the generated code or the Chip8 layout it compiles against changes
+const uint32_t AOT_ABI_VERSION = 1;
+
+// Runs the emulator's own decoder for an instruction a compiled block does not inline
+typedef void (*AotExecuteFunction)(Chip8& chip8, uint16_t opcode);
+// One compiled basic block; returns the instructions it retired
+typedef uint32_t (*AotBlockFunction)(Chip8& chip8, AotExecuteFunction execute);
+
+struct AotBlock
+{
+	uint16_t address;          // First instruction of the block
+	uint16_t length;           // Number of instructions
+	AotBlockFunction function;
+};
+
+// Shared library produced by Chip8Recompile for one ROM. step() runs the compiled
+// block starting at pc and falls back to Chip8::step() anywhere else: dynamic
+// jump targets, data executed as code, and everything after the ROM modified
+// bytes that were compiled.
+class AotModule
+{
+public:
+	~AotModule();
+
+	// Loads the library and checks it was compiled from the ROM currently in chip8
+	bool load(const char* fileName, Chip8& chip8);
+	void unload(Chip8& chip8);
+	bool isLoaded() const { return handle != nullptr; }
+
+	// Same contract as Chip8::step()
+	unsigned int step(Chip8& chip8)
+	{
+		if (chip8.codeModified || chip8.tracer || chip8.timingMode != TIMING_FIXED_RATE || chip8.runState != RUN_RUNNING)
+		{
+			return chip8.step();
+		}
+
+		AotBlockFunction function = blockFunctions[chip8.pc & (MEMORY_SIZE - 1)];
+		if (!function)
+		{
+			return chip8.step();
+		}
+		return function(chip8, &executeOpcode);
+	}
+
+	// Same, but retires at most maxInstructions so a frame can end on an exact instruction count
+	unsigned int step(Chip8& chip8, unsigned int maxInstructions)
+	{
+		uint16_t address = chip8.pc & (MEMORY_SIZE - 1);
+		if (blockLengths[address] > maxInstructions || chip8.fusedLength[address] > maxInstructions)
+		{
+			chip8.emulateCycle();
+			return 1;
+		}
+		return step(chip8);
+	}
+private:
+	static void executeOpcode(Chip8& chip8, uint16_t opcode);
+public:
+	unsigned int blockCount{};
+	uint64_t romHash{};
+private:
+	void* handle{};
+	AotBlockFunction blockFunctions[MEMORY_SIZE]{};
+	uint16_t blockLengths[MEMORY_SIZE]{};
+	uint8_t compiledBytes[MEMORY_SIZE]{};
+};
@@ -1,5 +1,11 @@
 #include "Chip8.h"
+#include "TraceRecorder.h"
+#include "Timing.h"
+#include "Diagnostics.h"
+#include "StateHash.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 
@@ -25,49 +31,148 @@ uint8_t fontSet[16 * 5] = {
 
 Chip8::Chip8()
 {
+	reset();
+}
+
+void Chip8::reset()
+{
+	memset(registers, 0, sizeof(registers));
+	memset(memory, 0, sizeof(memory));
+	memset(memoryWrites, 0xFF, sizeof(memoryWrites));
+	indexRegister = 0;
 	pc = PROGRAM_START_ADDRESS;
+	memset(stack, 0, sizeof(stack));
+	sp = 0;
+	opcode = 0;
+	delayTimer = 0;
+	soundTimer = 0;
+	memset(keypad, 0, sizeof(keypad));
+	memset(display, 0, sizeof(display));
+	memset(displayRows, 0, sizeof(displayRows));
+	romSize = 0;
+	cycleCount = 0;
+	frameCycleBalance = 0;
+	runState = RUN_RUNNING;
+	seedRandom(randomSeed);
 
 	// Load the fonts into memory starting at address 0x050 to 0x0A0 (80 bytes)
 	for (unsigned int i = 0; i < (16*5); ++i)
 	{
 		memory[FONTSET_START_ADDRESS + i] = fontSet[i];
 	}
+
+	// Superinstructions and compiled code describe the previous memory contents
+	memset(fusedOps, FUSED_NONE, sizeof(fusedOps));
+	memset(fusedLength, 0, sizeof(fusedLength));
+	hasFusedOps = false;
+	codeModified = false;
+
+	rehash();
 }
 
-void Chip8::loadROM(const char* romFileName)
+bool Chip8::loadROM(const char* romFileName)
 {
 	std::ifstream file(romFileName, std::ios::binary);
 
 	if (!file)
 	{
-		std::cerr << "Error: Failed to open ROM file." << std::endl;
-		return;
+		std::cerr << "Error: Failed to open ROM file: " << romFileName << std::endl;
+		return false;
 	}
 
 	file.seekg(0, std::ios::end);
 	std::streampos fileSize = file.tellg();
 
-	if (fileSize > MEMORY_SIZE - PROGRAM_START_ADDRESS) {
+	if (fileSize < 0 || fileSize > MEMORY_SIZE - PROGRAM_START_ADDRESS) {
 		std::cerr << "Error: ROM size exceeds available memory." << std::endl;
-		return;
+		return false;
 	}
 	
+	uint8_t romData[MEMORY_SIZE - PROGRAM_START_ADDRESS];
 	file.seekg(0, std::ios::beg);
-	file.read(reinterpret_cast<char*>(memory + 0x200) , fileSize);
+	file.read(reinterpret_cast<char*>(romData) , fileSize);
+
+	if (!file)
+	{
+		std::cerr << "Error: Failed to read ROM file: " << romFileName << std::endl;
+		return false;
+	}
 
 	file.close();
+
+	loadROM(romData, static_cast<size_t>(fileSize));
 	
 	std::cout << "Successfully loaded ROM: " << romFileName << std::endl;
+	return true;
+}
+
+bool Chip8::loadROM(const uint8_t* romData, size_t size)
+{
+	if (size > MEMORY_SIZE - PROGRAM_START_ADDRESS)
+	{
+		return false;
+	}
+
+	reset();
+	memcpy(memory + PROGRAM_START_ADDRESS, romData, size);
+	romSize = static_cast<uint16_t>(size);
+	rehash();
+
+	return true;
 }
 
 void Chip8::emulateCycle()
 {
+	if (runState != RUN_RUNNING)
+	{
+		return;
+	}
+
+	if (pc > MEMORY_SIZE - 2)
+	{
+		// Nothing has been fetched yet, so report the bad pc itself rather than pc - 2
+		diagnoseAt(DIAG_OUT_OF_RANGE, pc, pc);
+		pc &= MEMORY_SIZE - 1;
+	}
+
+	uint16_t fetchAddress = pc;
+
 	// Fetch opcode
-	opcode = memory[pc] << 8u | memory[pc + 1];
+	opcode = fetch(pc);
 	
 	// Increment the PC before executing anything
 	pc += 2;
 
+	execute();
+
+	// In TIMING_COSMAC_VIP the timers tick once per frame in runFrame()
+	if (timingMode == TIMING_FIXED_RATE)
+	{
+		if (delayTimer > 0)
+		{
+			--delayTimer;
+		}
+		if (soundTimer > 0)
+		{
+			--soundTimer;
+		}
+	}
+
+	if (tracer)
+	{
+		tracer->record(cycleCount, fetchAddress, opcode, indexRegister, sp, delayTimer, soundTimer, registers);
+	}
+	++cycleCount;
+}
+
+void Chip8::executeOpcode(uint16_t instruction)
+{
+	opcode = instruction;
+	execute();
+}
+
+void Chip8::execute()
+{
 	// Decode and execute opcode
 	switch (opcode & 0xF000u)
 	{
@@ -81,7 +186,7 @@ void Chip8::emulateCycle()
 			OP_00EE();
 			break;
 		default:
-			std::cerr << "Invalid opcode: 0x" << std::hex << opcode << std::endl;
+			diagnose(DIAG_INVALID_OPCODE, opcode);
 			break;
 		}
 		break;
@@ -137,7 +242,7 @@ void Chip8::emulateCycle()
 			OP_8XYE();
 			break;
 		default:
-			std::cerr << "Invalid opcode: 0x" << std::hex << opcode << std::endl;
+			diagnose(DIAG_INVALID_OPCODE, opcode);
 			break;
 		}
 		break;
@@ -166,7 +271,7 @@ void Chip8::emulateCycle()
 			OP_EXA1();
 			break;
 		default:
-			std::cerr << "Invalid opcode: 0x" << std::hex << opcode << std::endl;
+			diagnose(DIAG_INVALID_OPCODE, opcode);
 			break;
 		}
 		break;
@@ -201,32 +306,322 @@ void Chip8::emulateCycle()
 			OP_FX65();
 			break;
 		default:
-			std::cerr << "Invalid opcode: 0x" << std::hex << opcode << std::endl;
+			diagnose(DIAG_INVALID_OPCODE, opcode);
 			break;
 		}
 		break;
 	default:
-		std::cerr << "Invalid opcode: 0x" << std::hex << opcode << std::endl;
+		diagnose(DIAG_INVALID_OPCODE, opcode);
 		break;
 	}
+}
+
+unsigned int Chip8::step()
+{
+	uint16_t base = pc & (MEMORY_SIZE - 1);
+	uint8_t fused = fusedOps[base];
 
-	if (delayTimer > 0)
+	// Traces need one record per instruction and the VIP cost model needs every opcode,
+	// so superinstructions are skipped in both cases
+	if (fused == FUSED_NONE || tracer || timingMode != TIMING_FIXED_RATE || runState != RUN_RUNNING)
 	{
-		--delayTimer;
+		emulateCycle();
+		return 1;
 	}
-	if (soundTimer > 0)
+
+	// Each instruction still sees the timers and pc exactly as it would when run one by one
+	unsigned int retired = 0;
+	switch (fused)
 	{
-		--soundTimer;
+	case FUSED_ANNN_DXYN:
+		opcode = fetch(base);
+		OP_ANNN();
+		opcode = fetch(base + 2);
+		pc = base + 4;
+		OP_DXYN();
+		tickTimers(2);
+		retired = 2;
+		break;
+	case FUSED_TIMER_WAIT:
+		opcode = fetch(base);
+		OP_FX07();
+		tickTimers(1);
+		opcode = fetch(base + 2);
+		pc = base + 4;
+		OP_3XNN();
+		tickTimers(1);
+		retired = 2;
+		if (pc == base + 4)
+		{
+			opcode = fetch(base + 4);
+			pc = base + 6;
+			OP_1NNN();
+			tickTimers(1);
+			retired = 3;
+		}
+		break;
+	case FUSED_6XNN_RUN:
+		retired = fusedLength[base];
+		for (unsigned int i = 0; i < retired; ++i)
+		{
+			opcode = fetch(base + 2 * i);
+			OP_6XNN();
+		}
+		pc = base + 2 * retired;
+		tickTimers(retired);
+		break;
+	case FUSED_7XNN_3XNN:
+		opcode = fetch(base);
+		OP_7XNN();
+		opcode = fetch(base + 2);
+		pc = base + 4;
+		OP_3XNN();
+		tickTimers(2);
+		retired = 2;
+		break;
+	}
+
+	cycleCount += retired;
+	return retired;
+}
+
+unsigned int Chip8::runFrame(unsigned int instructionsPerFrame)
+{
+	unsigned int executed = 0;
+
+	if (timingMode == TIMING_FIXED_RATE)
+	{
+		while (executed < instructionsPerFrame)
+		{
+			// A superinstruction that does not fit runs one instruction at a time, so the frame
+			// ends on the same instruction as without fusion
+			if (fusedLength[pc & (MEMORY_SIZE - 1)] > instructionsPerFrame - executed)
+			{
+				emulateCycle();
+				++executed;
+			}
+			else
+			{
+				executed += step();
+			}
+		}
+		return executed;
+	}
+
+	frameCycleBalance += VIP_CYCLES_PER_FRAME;
+	while (frameCycleBalance > 0)
+	{
+		uint16_t address = pc;
+		uint16_t next = fetch(address);
+
+		// OP_DXYN waits for the vertical blank, so a draw that is not the first thing in a frame ends it
+		if ((next & 0xF000u) == 0xD000u && executed > 0)
+		{
+			frameCycleBalance = 0;
+			break;
+		}
+
+		emulateCycle();
+		++executed;
+
+		bool skipped = (pc == static_cast<uint16_t>(address + 4));
+		frameCycleBalance -= vipInstructionCycles(next, skipped);
+	}
+
+	tickTimers(1);
+	return executed;
+}
+
+void Chip8::saveState(Chip8State& state) const
+{
+	memcpy(state.registers, registers, sizeof(registers));
+	memcpy(state.memory, memory, sizeof(memory));
+	state.indexRegister = indexRegister;
+	state.pc = pc;
+	memcpy(state.stack, stack, sizeof(stack));
+	state.sp = sp;
+	state.opcode = opcode;
+	state.delayTimer = delayTimer;
+	state.soundTimer = soundTimer;
+	memcpy(state.display, display, sizeof(display));
+	memcpy(state.displayRows, displayRows, sizeof(displayRows));
+	state.cycleCount = cycleCount;
+	state.frameCycleBalance = frameCycleBalance;
+	state.memoryHash = memoryHash;
+	state.displayHash = displayHash;
+	state.randomState = randomState;
+	state.runState = runState;
+}
+
+void Chip8::loadState(const Chip8State& state)
+{
+	memcpy(registers, state.registers, sizeof(registers));
+	for (unsigned int address = 0; address < MEMORY_SIZE; ++address)
+	{
+		if (memory[address] != state.memory[address])
+		{
+			memoryChanged[address >> 6u] |= 1ull << (address & 63u);
+		}
+	}
+	memcpy(memory, state.memory, sizeof(memory));
+	indexRegister = state.indexRegister;
+	pc = state.pc;
+	memcpy(stack, state.stack, sizeof(stack));
+	sp = state.sp;
+	opcode = state.opcode;
+	delayTimer = state.delayTimer;
+	soundTimer = state.soundTimer;
+	memcpy(display, state.display, sizeof(display));
+	memcpy(displayRows, state.displayRows, sizeof(displayRows));
+	cycleCount = state.cycleCount;
+	frameCycleBalance = state.frameCycleBalance;
+	memoryHash = state.memoryHash;
+	displayHash = state.displayHash;
+	randomState = state.randomState;
+	runState = state.runState;
+
+	// Superinstructions dropped since the snapshot stay dropped, they are only a cache
+}
+
+uint64_t Chip8::stateHash() const
+{
+	// The CPU state is small enough to mix in on every call
+	uint64_t words[8];
+	memcpy(&words[0], registers, sizeof(registers));
+	memcpy(&words[2], stack, sizeof(stack));
+	words[6] = static_cast<uint64_t>(indexRegister) | static_cast<uint64_t>(pc) << 16u;
+	words[7] = static_cast<uint64_t>(sp) | static_cast<uint64_t>(delayTimer) << 8u | static_cast<uint64_t>(soundTimer) << 16u |
+		static_cast<uint64_t>(randomState) << 32u;
+
+	uint64_t hash = memoryHash ^ displayHash;
+	for (uint64_t word : words)
+	{
+		hash = mixHash(hash ^ word);
+	}
+	return hash;
+}
+
+void Chip8::seedRandom(uint32_t seed)
+{
+	randomSeed = seed;
+	// xorshift never leaves zero
+	randomState = seed ? seed : 0x9E3779B9u;
+}
+
+void Chip8::rehash()
+{
+	memoryHash = 0;
+	for (unsigned int address = 0; address < MEMORY_SIZE; ++address)
+	{
+		memoryHash ^= memoryByteHash(address, memory[address]);
+	}
+
+	displayHash = 0;
+	for (unsigned int y = 0; y < DISPLAY_HEIGHT; ++y)
+	{
+		displayHash ^= displayRowHash(y, displayRows[y]);
+	}
+}
+
+void Chip8::writeMemory(uint16_t address, uint8_t value)
+{
+	address &= MEMORY_SIZE - 1;
+	memoryHash ^= memoryByteHash(address, memory[address]) ^ memoryByteHash(address, value);
+	memory[address] = value;
+	(speculative ? memoryChanged : memoryWrites)[address >> 6u] |= 1ull << (address & 63u);
+}
+
+void Chip8::tickTimers(unsigned int cycles)
+{
+	delayTimer = (delayTimer > cycles) ? delayTimer - cycles : 0;
+	soundTimer = (soundTimer > cycles) ? soundTimer - cycles : 0;
+}
+
+void Chip8::memoryWritten(uint16_t address, unsigned int length)
+{
+	if (codeWatch)
+	{
+		for (unsigned int i = 0; i < length; ++i)
+		{
+			if (codeWatch[(address + i) & (MEMORY_SIZE - 1)])
+			{
+				codeModified = true;
+			}
+		}
+	}
+
+	if (!hasFusedOps)
+	{
+		return;
+	}
+
+	// I can point past the end of memory and the write wraps around like the stores did
+	unsigned int begin = address & (MEMORY_SIZE - 1);
+	unsigned int end = begin + length;
+	dropFusedOps(begin, std::min(end, MEMORY_SIZE));
+	if (end > MEMORY_SIZE)
+	{
+		dropFusedOps(0, end - MEMORY_SIZE);
+	}
+}
+
+void Chip8::dropFusedOps(unsigned int begin, unsigned int end)
+{
+	// Drop every superinstruction whose bytes overlap [begin, end)
+	unsigned int first = (begin >= 2 * MAX_FUSED_LENGTH - 1) ? begin - (2 * MAX_FUSED_LENGTH - 1) : 0;
+	for (unsigned int i = first; i < end; ++i)
+	{
+		if (fusedOps[i] != FUSED_NONE && i + 2u * fusedLength[i] > begin)
+		{
+			fusedOps[i] = FUSED_NONE;
+		}
 	}
 }
 
 void Chip8::OP_00E0()
 {
 	memset(display, 0, sizeof(display));
+	memset(displayRows, 0, sizeof(displayRows));
+
+	displayHash = 0;
+	for (unsigned int y = 0; y < DISPLAY_HEIGHT; ++y)
+	{
+		displayHash ^= displayRowHash(y, 0);
+	}
+}
+
+void Chip8::diagnose(DiagnosticKind kind, uint16_t address)
+{
+	// pc already points past the instruction being executed
+	diagnoseAt(kind, pc - 2, address);
+}
+
+void Chip8::diagnoseAt(DiagnosticKind kind, uint16_t instructionAddress, uint16_t address)
+{
+	if (!diagnostics)
+	{
+		return;
+	}
+
+	DiagnosticPolicy policy = diagnostics->report(kind, cycleCount, instructionAddress, opcode, address);
+	if (policy == POLICY_HALT)
+	{
+		runState = RUN_HALTED;
+	}
+	else if (policy == POLICY_TRAP)
+	{
+		runState = RUN_TRAPPED;
+	}
 }
 
 void Chip8::OP_00EE()
 {
+	if (sp == 0)
+	{
+		diagnose(DIAG_STACK_UNDERFLOW, pc - 2);
+		return;
+	}
+
 	--sp;
 	pc = stack[sp];
 }
@@ -241,6 +636,12 @@ void Chip8::OP_2NNN()
 {
 	uint16_t address = opcode & 0x0FFFu;
 
+	if (sp >= 16)
+	{
+		diagnose(DIAG_STACK_OVERFLOW, address);
+		return;
+	}
+
 	stack[sp] = pc;
 	++sp;
 	pc = address;
@@ -415,37 +816,73 @@ void Chip8::OP_CXNN()
 	uint8_t VX = (opcode >> 8u) & 0x0Fu;
 	uint8_t ValueNN = opcode & 0x00FFu;
 
-	uint8_t randomValue = std::rand() & 0xFFu;
+	randomState ^= randomState << 13u;
+	randomState ^= randomState >> 17u;
+	randomState ^= randomState << 5u;
+	uint8_t randomValue = (randomState >> 24u) & 0xFFu;
 
 	registers[VX] = randomValue & ValueNN;
 }
 
 void Chip8::OP_DXYN()
 {
-	uint8_t VX = registers[(opcode >> 8u) & 0x0Fu];
-	uint8_t VY = registers[(opcode >> 4u) & 0x0Fu];
+	// The starting coordinate always wraps, pixels past the edges are clipped or wrapped per quirk
+	unsigned int VX = registers[(opcode >> 8u) & 0x0Fu] % DISPLAY_WIDTH;
+	unsigned int VY = registers[(opcode >> 4u) & 0x0Fu] % DISPLAY_HEIGHT;
 	uint8_t height = opcode & 0x000Fu;
 
 	registers[0xF] = 0;
 
 	for (uint8_t row = 0; row < height; ++row)
 	{
-		uint8_t spriteByte = memory[indexRegister + row];
+		unsigned int y = VY + row;
+		if (y >= DISPLAY_HEIGHT)
+		{
+			if (!quirks.wrapSprites)
+			{
+				break;
+			}
+			y -= DISPLAY_HEIGHT;
+		}
+
+		uint8_t spriteByte = memory[(indexRegister + row) & (MEMORY_SIZE - 1)];
+		if (!spriteByte)
+		{
+			continue;
+		}
 
-		for (uint8_t col = 0; col < 8; ++col)
+		// Line the sprite up with the row, the leftmost pixel is the most significant bit
+		uint64_t spriteRow = static_cast<uint64_t>(spriteByte) << 56u;
+		uint64_t mask = spriteRow >> VX;
+		if (quirks.wrapSprites && VX > 0)
 		{
-			uint8_t spritePixel = spriteByte & (0x80u >> col);
-			uint32_t* screenPixel = &display[(VX + col) + (VY + row) * DISPLAY_WIDTH];
+			mask |= spriteRow << (DISPLAY_WIDTH - VX);
+		}
 
-			// Map the sprite pixel to the corresponding RGBA value.
-			uint32_t rgbaSpritePixel = spritePixel ? 0xFFFFFFFF : 0x00000000;
+		if (displayRows[y] & mask)
+		{
+			registers[0xF] = 1;
+		}
+		displayHash ^= displayRowHash(y, displayRows[y]) ^ displayRowHash(y, displayRows[y] ^ mask);
+		displayRows[y] ^= mask;
 
-			if (spritePixel && *screenPixel == 0xFFFFFFFF)
+		// Mirror the flipped pixels into the RGBA framebuffer
+		uint32_t* screenRow = &display[y * DISPLAY_WIDTH];
+		for (unsigned int col = 0; col < 8; ++col)
+		{
+			if (spriteByte & (0x80u >> col))
 			{
-				registers[0xF] = 1;
+				unsigned int x = VX + col;
+				if (x >= DISPLAY_WIDTH)
+				{
+					if (!quirks.wrapSprites)
+					{
+						break;
+					}
+					x -= DISPLAY_WIDTH;
+				}
+				screenRow[x] ^= 0xFFFFFFFF;
 			}
-
-			*screenPixel ^= rgbaSpritePixel;
 		}
 	}
 }
@@ -453,8 +890,13 @@ void Chip8::OP_DXYN()
 void Chip8::OP_EX9E()
 {
 	uint8_t VX = (opcode >> 8u) & 0x0Fu;
+
+	if (registers[VX] > 0xF)
+	{
+		diagnose(DIAG_OUT_OF_RANGE, registers[VX]);
+	}
 	
-	if (keypad[registers[VX]])
+	if (keypad[registers[VX] & 0x0Fu])
 	{
 		pc += 2;
 	}
@@ -464,7 +906,12 @@ void Chip8::OP_EXA1()
 {
 	uint8_t VX = (opcode >> 8u) & 0x0Fu;
 
-	if (!keypad[registers[VX]])
+	if (registers[VX] > 0xF)
+	{
+		diagnose(DIAG_OUT_OF_RANGE, registers[VX]);
+	}
+
+	if (!keypad[registers[VX] & 0x0Fu])
 	{
 		pc += 2;
 	}
@@ -537,29 +984,49 @@ void Chip8::OP_FX33()
 	uint8_t tens = (value / 10) % 10;
 	uint8_t ones = value % 10;
 
+	// Report the first byte past the end, I itself once FX1E has pushed it there
+	if (indexRegister + 2u >= MEMORY_SIZE)
+	{
+		diagnose(DIAG_OUT_OF_RANGE, static_cast<uint16_t>(std::max<unsigned int>(indexRegister, MEMORY_SIZE)));
+	}
+
 	// Store BCD representation in memory
-	memory[indexRegister] = hundreds;
-	memory[indexRegister + 1] = tens;
-	memory[indexRegister + 2] = ones;
+	writeMemory(indexRegister, hundreds);
+	writeMemory(indexRegister + 1, tens);
+	writeMemory(indexRegister + 2, ones);
+
+	memoryWritten(indexRegister, 3);
 }
 
 void Chip8::OP_FX55()
 {
 	uint8_t VX = (opcode >> 8u) & 0x0Fu;
 
+	if (indexRegister + VX >= MEMORY_SIZE)
+	{
+		diagnose(DIAG_OUT_OF_RANGE, static_cast<uint16_t>(std::max<unsigned int>(indexRegister, MEMORY_SIZE)));
+	}
+
 	for (uint8_t i = 0; i <= VX; ++i)
 	{
-		memory[indexRegister + i] = registers[i];
+		writeMemory(indexRegister + i, registers[i]);
 	}
+
+	memoryWritten(indexRegister, VX + 1);
 }
 
 void Chip8::OP_FX65()
 {
 	uint8_t VX = (opcode >> 8u) & 0x0Fu;
 
+	if (indexRegister + VX >= MEMORY_SIZE)
+	{
+		diagnose(DIAG_OUT_OF_RANGE, static_cast<uint16_t>(std::max<unsigned int>(indexRegister, MEMORY_SIZE)));
+	}
+
 	for (uint8_t i = 0; i <= VX; ++i)
 	{
-		registers[i] = memory[indexRegister + i];
+		registers[i] = memory[(indexRegister + i) & (MEMORY_SIZE - 1)];
 	}
 }
 
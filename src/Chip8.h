@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 const unsigned int MEMORY_SIZE = 0x1000;
@@ -8,13 +9,101 @@ const unsigned int FONTSET_START_ADDRESS = 0x050;
 const unsigned int DISPLAY_WIDTH = 64;
 const unsigned int DISPLAY_HEIGHT = 32;
 
+class TraceRecorder;
+class Diagnostics;
+enum DiagnosticKind : uint8_t;
+
+enum RunState : uint8_t
+{
+	RUN_RUNNING = 0,
+	RUN_HALTED,   // Stopped by a diagnostic with POLICY_HALT
+	RUN_TRAPPED   // Paused by a diagnostic with POLICY_TRAP, resumable from the debugger
+};
+
+// Superinstructions installed by fuseSuperinstructions(), each runs a hot opcode sequence in one dispatch
+enum FusedOp : uint8_t
+{
+	FUSED_NONE = 0,
+	FUSED_ANNN_DXYN,     // ANNN, DXYN: sprite draw
+	FUSED_TIMER_WAIT,    // FX07, 3XNN, 1NNN: one iteration of a delay timer wait loop
+	FUSED_6XNN_RUN,      // Up to MAX_FUSED_LENGTH consecutive 6XNN: register setup
+	FUSED_7XNN_3XNN      // 7XNN, 3XNN: loop counter
+};
+
+const unsigned int MAX_FUSED_LENGTH = 8;
+
+enum TimingMode : uint8_t
+{
+	TIMING_FIXED_RATE = 0, // Every instruction is one tick of the cycle rate and ticks the timers
+	TIMING_COSMAC_VIP      // Per-instruction COSMAC VIP cycle costs, timers and display waits at 60 Hz
+};
+
+// Behaviors that differ between CHIP-8 interpreters
+struct Chip8Quirks
+{
+	bool wrapSprites{};  // Wrap sprite pixels around the screen edges instead of clipping them
+};
+
+// Everything needed to resume emulation exactly, for in-memory snapshots
+struct Chip8State
+{
+	uint8_t registers[16];
+	uint8_t memory[MEMORY_SIZE];
+	uint16_t indexRegister;
+	uint16_t pc;
+	uint16_t stack[16];
+	uint8_t sp;
+	uint16_t opcode;
+	uint8_t delayTimer;
+	uint8_t soundTimer;
+	uint32_t display[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+	uint64_t displayRows[DISPLAY_HEIGHT];
+	uint64_t cycleCount;
+	int32_t frameCycleBalance;
+	uint64_t memoryHash;
+	uint64_t displayHash;
+	uint32_t randomState;
+	RunState runState;
+};
+
 class Chip8
 {
 public:
 	Chip8();
-	void loadROM(const char* romFileName);
+	// Powers the machine back on: clears everything the ROM can change and reloads the font.
+	// Settings (quirks, timing, tracer, diagnostics) are kept.
+	void reset();
+	// Resets the machine and loads a ROM; the machine is untouched if the ROM cannot be loaded
+	bool loadROM(const char* romFileName);
+	// Same for a ROM image that is already in memory, without logging; false if it does not fit
+	bool loadROM(const uint8_t* romData, size_t size);
 	void emulateCycle();
+	// Runs the superinstruction at pc if there is one, otherwise a single cycle; returns the instructions retired
+	unsigned int step();
+	// Executes one already fetched instruction with pc pointing past it; no timers, trace or cycle count
+	void executeOpcode(uint16_t instruction);
+	// Runs one 60 Hz frame: instructionsPerFrame instructions in TIMING_FIXED_RATE, or as many as
+	// the cycle budget allows in TIMING_COSMAC_VIP. Returns the instructions executed.
+	unsigned int runFrame(unsigned int instructionsPerFrame);
+	// Snapshot and restore of the machine state; the keypad is input and is left alone
+	void saveState(Chip8State& state) const;
+	void loadState(const Chip8State& state);
+	// Hash of the machine state (CPU, memory, display and RNG, not the keypad or cycle count) for
+	// deduplication. O(1): memory and display are hashed incrementally as they are written.
+	uint64_t stateHash() const;
+	// Restarts the OP_CXNN random sequence; reset() goes back to randomSeed
+	void seedRandom(uint32_t seed);
+	// Recomputes the incremental hashes, needed after writing memory or displayRows from outside
+	void rehash();
 private:
+	void tickTimers(unsigned int cycles);
+	void diagnose(DiagnosticKind kind, uint16_t address);
+	void diagnoseAt(DiagnosticKind kind, uint16_t instructionAddress, uint16_t address);
+	void execute();
+	void memoryWritten(uint16_t address, unsigned int length);
+	void dropFusedOps(unsigned int begin, unsigned int end);
+	void writeMemory(uint16_t address, uint8_t value);
+	uint16_t fetch(uint16_t address) const { return memory[address & (MEMORY_SIZE - 1)] << 8u | memory[(address + 1) & (MEMORY_SIZE - 1)]; }
 	void OP_00E0();
 	void OP_00EE();
 	void OP_1NNN();
@@ -61,4 +150,45 @@ public:
 	uint8_t soundTimer{};
 	uint8_t keypad[16]{};
 	uint32_t display[DISPLAY_WIDTH * DISPLAY_HEIGHT]{};
+	// One bit per pixel, bit 63 is the leftmost column; kept in sync with display by OP_DXYN and OP_00E0
+	uint64_t displayRows[DISPLAY_HEIGHT]{};
+	uint16_t romSize{};
+	uint64_t cycleCount{};
+	Chip8Quirks quirks;
+	TimingMode timingMode{ TIMING_FIXED_RATE };
+	// Machine cycles left over from (or owed by) the previous frame in TIMING_COSMAC_VIP
+	int32_t frameCycleBalance{};
+
+	// One bit per memory byte written since the debugger last cleared it: OP_FX33, OP_FX55,
+	// reset and ROM loads set bits, the memory viewer consumes them
+	uint64_t memoryWrites[MEMORY_SIZE / 64]{};
+	// Same for bytes the running program did not really write: snapshot restores and writes in
+	// speculative frames. The memory viewer reformats them without lighting them up.
+	uint64_t memoryChanged[MEMORY_SIZE / 64]{};
+	// Set while running frames that may be thrown away (run-ahead, unconfirmed netplay frames)
+	bool speculative{};
+
+	// Running XOR of memoryByteHash() over memory and displayRowHash() over displayRows
+	uint64_t memoryHash{};
+	uint64_t displayHash{};
+
+	// xorshift32 state for OP_CXNN, part of snapshots so rollbacks replay the same numbers
+	uint32_t randomSeed{ 1 };
+	uint32_t randomState{ 1 };
+
+	RunState runState{ RUN_RUNNING };
+
+	// Optional per-instruction trace, nullptr when tracing is off
+	TraceRecorder* tracer{};
+	// Where problems are reported, nullptr to ignore them silently
+	Diagnostics* diagnostics{};
+
+	// Superinstruction starting at each address and the number of instructions it covers
+	uint8_t fusedOps[MEMORY_SIZE]{};
+	uint8_t fusedLength[MEMORY_SIZE]{};
+	bool hasFusedOps{};
+
+	// Bytes precompiled code depends on (nonzero entries); a write to one sets codeModified
+	const uint8_t* codeWatch{};
+	bool codeModified{};
 };
\ No newline at end of file
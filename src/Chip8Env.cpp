@@ -0,0 +1,315 @@
+#include "Chip8Env.h"
+#include "Chip8.h"
+#include "Diagnostics.h"
+#include "StateHash.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+const unsigned int MAX_REWARD_TERMS = 16;
+
+struct RewardTerm
+{
+	uint16_t address;
+	float weight;
+	bool isSigned;
+};
+
+struct Chip8Env
+{
+	std::vector<Chip8> machines;
+	Chip8State initialState;
+	uint32_t instructionsPerFrame{ 9 };
+	uint32_t frameSkip{ 1 };
+	RewardTerm rewardTerms[MAX_REWARD_TERMS];
+	unsigned int rewardTermCount{};
+
+	// Arguments of the step in progress, read by the workers
+	const uint16_t* actions{};
+	float* rewards{};
+	uint8_t* done{};
+
+	// Persistent workers pull chunks of environments until none are left; the calling thread helps
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	uint64_t generation{};
+	unsigned int busyWorkers{};
+	bool stopping{};
+	std::atomic<uint32_t> nextChunk{ 0 };
+	uint32_t chunkSize{ 1 };
+	uint32_t chunkCount{};
+
+	// One per thread, the calling thread uses [0]; report() only takes a single producer.
+	// Never started, they only count faults and decide the policy.
+	std::unique_ptr<Diagnostics[]> diagnostics;
+};
+
+static float readRewardByte(const Chip8& chip8, const RewardTerm& term)
+{
+	uint8_t value = chip8.memory[term.address & (MEMORY_SIZE - 1)];
+	return term.isSigned ? static_cast<float>(static_cast<int8_t>(value)) : static_cast<float>(value);
+}
+
+static void stepMachine(Chip8Env* env, uint32_t index, Diagnostics* diagnostics)
+{
+	Chip8& chip8 = env->machines[index];
+	chip8.diagnostics = diagnostics;
+
+	uint16_t action = env->actions ? env->actions[index] : 0;
+	for (unsigned int key = 0; key < 16; ++key)
+	{
+		chip8.keypad[key] = (action >> key) & 1u;
+	}
+
+	float before[MAX_REWARD_TERMS];
+	for (unsigned int i = 0; i < env->rewardTermCount; ++i)
+	{
+		before[i] = readRewardByte(chip8, env->rewardTerms[i]);
+	}
+
+	for (uint32_t frame = 0; frame < env->frameSkip && chip8.runState == RUN_RUNNING; ++frame)
+	{
+		chip8.runFrame(env->instructionsPerFrame);
+	}
+
+	if (env->rewards)
+	{
+		float reward = 0.0f;
+		for (unsigned int i = 0; i < env->rewardTermCount; ++i)
+		{
+			reward += env->rewardTerms[i].weight * (readRewardByte(chip8, env->rewardTerms[i]) - before[i]);
+		}
+		env->rewards[index] = reward;
+	}
+	if (env->done)
+	{
+		env->done[index] = chip8.runState != RUN_RUNNING;
+	}
+	chip8.diagnostics = nullptr;
+}
+
+static void runChunks(Chip8Env* env, Diagnostics* diagnostics)
+{
+	uint32_t count = static_cast<uint32_t>(env->machines.size());
+	for (uint32_t chunk = env->nextChunk++; chunk < env->chunkCount; chunk = env->nextChunk++)
+	{
+		uint32_t end = std::min(count, (chunk + 1) * env->chunkSize);
+		for (uint32_t index = chunk * env->chunkSize; index < end; ++index)
+		{
+			stepMachine(env, index, diagnostics);
+		}
+	}
+}
+
+static void workerLoop(Chip8Env* env, Diagnostics* diagnostics)
+{
+	uint64_t seenGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(env->mutex);
+			env->wake.wait(lock, [&]() { return env->stopping || env->generation != seenGeneration; });
+			if (env->stopping)
+			{
+				return;
+			}
+			seenGeneration = env->generation;
+		}
+
+		runChunks(env, diagnostics);
+
+		std::lock_guard<std::mutex> lock(env->mutex);
+		if (--env->busyWorkers == 0)
+		{
+			env->finished.notify_one();
+		}
+	}
+}
+
+Chip8Env* chip8EnvCreate(uint32_t count, const uint8_t* rom, size_t romSize, uint32_t threads)
+{
+	Chip8 prototype;
+	if (count == 0 || !prototype.loadROM(rom, romSize))
+	{
+		return nullptr;
+	}
+
+	Chip8Env* env = new Chip8Env;
+	prototype.saveState(env->initialState);
+	env->machines.assign(count, prototype);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		env->machines[i].seedRandom(static_cast<uint32_t>(mixHash(i)));
+	}
+
+	if (threads == 0)
+	{
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	threads = std::min(threads, count);
+
+	// A few chunks per thread balances ROMs that run unevenly without much contention on nextChunk
+	env->chunkSize = std::max(1u, count / (threads * 8));
+	env->chunkCount = (count + env->chunkSize - 1) / env->chunkSize;
+
+	// Invalid opcodes and stack faults end the episode; wrapped accesses are defined behavior
+	env->diagnostics.reset(new Diagnostics[threads]);
+	for (uint32_t i = 0; i < threads; ++i)
+	{
+		env->diagnostics[i].policies[DIAG_INVALID_OPCODE] = POLICY_HALT;
+		env->diagnostics[i].policies[DIAG_STACK_OVERFLOW] = POLICY_HALT;
+		env->diagnostics[i].policies[DIAG_STACK_UNDERFLOW] = POLICY_HALT;
+	}
+
+	for (uint32_t i = 1; i < threads; ++i)
+	{
+		env->workers.emplace_back(workerLoop, env, &env->diagnostics[i]);
+	}
+	return env;
+}
+
+void chip8EnvDestroy(Chip8Env* env)
+{
+	if (!env)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(env->mutex);
+		env->stopping = true;
+	}
+	env->wake.notify_all();
+	for (std::thread& worker : env->workers)
+	{
+		worker.join();
+	}
+	delete env;
+}
+
+uint32_t chip8EnvCount(const Chip8Env* env)
+{
+	return static_cast<uint32_t>(env->machines.size());
+}
+
+void chip8EnvSetInstructionsPerFrame(Chip8Env* env, uint32_t instructions)
+{
+	env->instructionsPerFrame = instructions;
+}
+
+void chip8EnvSetFrameSkip(Chip8Env* env, uint32_t frames)
+{
+	env->frameSkip = std::max(1u, frames);
+}
+
+int chip8EnvAddRewardTerm(Chip8Env* env, uint16_t address, float weight, int isSigned)
+{
+	if (env->rewardTermCount >= MAX_REWARD_TERMS)
+	{
+		return 0;
+	}
+
+	RewardTerm& term = env->rewardTerms[env->rewardTermCount++];
+	term.address = address;
+	term.weight = weight;
+	term.isSigned = isSigned != 0;
+	return 1;
+}
+
+void chip8EnvClearRewardTerms(Chip8Env* env)
+{
+	env->rewardTermCount = 0;
+}
+
+void chip8EnvReset(Chip8Env* env, const uint32_t* indices, uint32_t indexCount)
+{
+	uint32_t count = indices ? indexCount : static_cast<uint32_t>(env->machines.size());
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t index = indices ? indices[i] : i;
+		if (index >= env->machines.size())
+		{
+			continue;
+		}
+
+		Chip8& chip8 = env->machines[index];
+		chip8.loadState(env->initialState);
+		// initialState holds the prototype's random state, each environment restarts its own
+		chip8.seedRandom(chip8.randomSeed);
+		memset(chip8.keypad, 0, sizeof(chip8.keypad));
+		chip8.runState = RUN_RUNNING;
+	}
+}
+
+void chip8EnvSeed(Chip8Env* env, uint32_t index, uint32_t seed)
+{
+	if (index < env->machines.size())
+	{
+		env->machines[index].seedRandom(seed);
+	}
+}
+
+void chip8EnvStep(Chip8Env* env, const uint16_t* actions, float* rewards, uint8_t* done)
+{
+	{
+		std::lock_guard<std::mutex> lock(env->mutex);
+		env->actions = actions;
+		env->rewards = rewards;
+		env->done = done;
+		env->nextChunk = 0;
+		env->busyWorkers = static_cast<unsigned int>(env->workers.size());
+		++env->generation;
+	}
+	env->wake.notify_all();
+
+	runChunks(env, &env->diagnostics[0]);
+
+	std::unique_lock<std::mutex> lock(env->mutex);
+	env->finished.wait(lock, [&]() { return env->busyWorkers == 0; });
+}
+
+size_t chip8EnvObservationSize(int format)
+{
+	return format == CHIP8_OBSERVE_BITS ? DISPLAY_HEIGHT * DISPLAY_WIDTH / 8 : DISPLAY_HEIGHT * DISPLAY_WIDTH;
+}
+
+void chip8EnvObserve(const Chip8Env* env, uint8_t* observations, int format)
+{
+	for (const Chip8& chip8 : env->machines)
+	{
+		for (unsigned int y = 0; y < DISPLAY_HEIGHT; ++y)
+		{
+			uint64_t row = chip8.displayRows[y];
+			if (format == CHIP8_OBSERVE_BITS)
+			{
+				for (int shift = 56; shift >= 0; shift -= 8)
+				{
+					*observations++ = static_cast<uint8_t>(row >> shift);
+				}
+			}
+			else
+			{
+				for (int shift = 63; shift >= 0; --shift)
+				{
+					*observations++ = static_cast<uint8_t>((row >> shift) & 1u);
+				}
+			}
+		}
+	}
+}
+
+void chip8EnvStateHashes(const Chip8Env* env, uint64_t* hashes)
+{
+	for (const Chip8& chip8 : env->machines)
+	{
+		*hashes++ = chip8.stateHash();
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+// C interface for driving many emulators at once from training code, built as the
+// Chip8Env shared library. All buffers are caller-owned and laid out per
+// environment, so stepping allocates nothing; environments are stepped in
+// parallel on a pool of worker threads.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Chip8Env Chip8Env;
+
+enum Chip8ObservationFormat
+{
+	CHIP8_OBSERVE_BYTES = 0, // uint8_t[count][32][64], 1 for a lit pixel
+	CHIP8_OBSERVE_BITS = 1   // uint8_t[count][32][8], leftmost pixel in the most significant bit
+};
+
+// count environments running the same ROM; threads 0 uses every hardware thread.
+// Environment i starts with an OP_CXNN seed derived from i, so no two share a random sequence.
+// Returns NULL if the ROM does not fit in memory.
+Chip8Env* chip8EnvCreate(uint32_t count, const uint8_t* rom, size_t romSize, uint32_t threads);
+void chip8EnvDestroy(Chip8Env* env);
+uint32_t chip8EnvCount(const Chip8Env* env);
+
+// Instructions per 60 Hz frame (default 9) and frames run by every step (default 1)
+void chip8EnvSetInstructionsPerFrame(Chip8Env* env, uint32_t instructions);
+void chip8EnvSetFrameSkip(Chip8Env* env, uint32_t frames);
+
+// Adds weight * (new - old value of the byte at address) to every step's reward, e.g. a
+// score counter. Bytes are read as unsigned unless isSigned. Returns 0 if all 16 terms are used.
+int chip8EnvAddRewardTerm(Chip8Env* env, uint16_t address, float weight, int isSigned);
+void chip8EnvClearRewardTerms(Chip8Env* env);
+
+// Puts the listed environments (all of them if indices is NULL) back to the state right
+// after the ROM was loaded, with no keys down and the random sequence restarted from their seed
+void chip8EnvReset(Chip8Env* env, const uint32_t* indices, uint32_t indexCount);
+
+// Replaces environment index's OP_CXNN seed and restarts its random sequence; later resets keep it
+void chip8EnvSeed(Chip8Env* env, uint32_t index, uint32_t seed);
+
+// Holds actions[i] (bit N = key N down) on environment i for frameSkip frames.
+// rewards (float[count]) and done (uint8_t[count], 1 once the machine stopped on an invalid
+// opcode or a stack over- or underflow) may be NULL. A stopped environment stays stopped until reset.
+void chip8EnvStep(Chip8Env* env, const uint16_t* actions, float* rewards, uint8_t* done);
+
+// Writes every environment's display into observations in the given format
+void chip8EnvObserve(const Chip8Env* env, uint8_t* observations, int format);
+// Size in bytes of one environment's observation in the given format
+size_t chip8EnvObservationSize(int format);
+
+// Chip8::stateHash() of every environment (uint64_t[count]), for deduplicating states
+void chip8EnvStateHashes(const Chip8Env* env, uint64_t* hashes);
+
+#ifdef __cplusplus
+}
+#endif
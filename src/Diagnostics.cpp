@@ -0,0 +1,131 @@
+#include "Diagnostics.h"
+
+#include <chrono>
+#include <cstdio>
+
+const char* diagnosticName(DiagnosticKind kind)
+{
+	switch (kind)
+	{
+	case DIAG_INVALID_OPCODE: return "Invalid opcode";
+	case DIAG_STACK_OVERFLOW: return "Stack overflow";
+	case DIAG_STACK_UNDERFLOW: return "Stack underflow";
+	case DIAG_OUT_OF_RANGE: return "Out-of-range access";
+	default: return "Unknown diagnostic";
+	}
+}
+
+Diagnostics::Diagnostics()
+	: dropped(0), suppressed(0), head(0), tail(0), running(false)
+{
+	for (unsigned int i = 0; i < DIAG_KIND_COUNT; ++i)
+	{
+		policies[i] = POLICY_IGNORE;
+		counts[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+Diagnostics::~Diagnostics()
+{
+	stop();
+}
+
+void Diagnostics::start()
+{
+	if (running.exchange(true))
+	{
+		return;
+	}
+	worker = std::thread(&Diagnostics::drain, this);
+}
+
+void Diagnostics::stop()
+{
+	if (!running.exchange(false))
+	{
+		return;
+	}
+	worker.join();
+}
+
+void Diagnostics::setPolicy(DiagnosticPolicy policy)
+{
+	for (unsigned int i = 0; i < DIAG_KIND_COUNT; ++i)
+	{
+		policies[i] = policy;
+	}
+}
+
+DiagnosticPolicy Diagnostics::report(DiagnosticKind kind, uint64_t cycle, uint16_t pc, uint16_t opcode, uint16_t address)
+{
+	counts[kind].fetch_add(1, std::memory_order_relaxed);
+
+	unsigned int currentTail = tail.load(std::memory_order_relaxed);
+	unsigned int nextTail = (currentTail + 1) % DIAGNOSTIC_QUEUE_SIZE;
+	if (nextTail == head.load(std::memory_order_acquire))
+	{
+		dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+	else
+	{
+		DiagnosticEvent& event = queue[currentTail];
+		event.cycle = cycle;
+		event.pc = pc;
+		event.opcode = opcode;
+		event.address = address;
+		event.kind = kind;
+		tail.store(nextTail, std::memory_order_release);
+	}
+
+	return policies[kind];
+}
+
+void Diagnostics::drain()
+{
+	auto windowStart = std::chrono::steady_clock::now();
+	unsigned int linesThisWindow = 0;
+	uint64_t suppressedThisWindow = 0;
+
+	while (true)
+	{
+		bool stopping = !running.load(std::memory_order_acquire);
+
+		unsigned int currentHead = head.load(std::memory_order_relaxed);
+		while (currentHead != tail.load(std::memory_order_acquire))
+		{
+			const DiagnosticEvent& event = queue[currentHead];
+			if (linesThisWindow < maxLinesPerSecond)
+			{
+				fprintf(stderr, "%s at cycle %llu: PC 0x%03X opcode 0x%04X address 0x%04X\n", diagnosticName(event.kind),
+					static_cast<unsigned long long>(event.cycle), event.pc, event.opcode, event.address);
+				++linesThisWindow;
+			}
+			else
+			{
+				++suppressedThisWindow;
+			}
+
+			currentHead = (currentHead + 1) % DIAGNOSTIC_QUEUE_SIZE;
+			head.store(currentHead, std::memory_order_release);
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (now - windowStart >= std::chrono::seconds(1) || stopping)
+		{
+			if (suppressedThisWindow)
+			{
+				fprintf(stderr, "... %llu more diagnostics suppressed\n", static_cast<unsigned long long>(suppressedThisWindow));
+				suppressed.fetch_add(suppressedThisWindow, std::memory_order_relaxed);
+			}
+			windowStart = now;
+			linesThisWindow = 0;
+			suppressedThisWindow = 0;
+		}
+
+		if (stopping)
+		{
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+enum DiagnosticKind : uint8_t
+{
+	DIAG_INVALID_OPCODE = 0,
+	DIAG_STACK_OVERFLOW,     // OP_2NNN with all 16 stack levels in use
+	DIAG_STACK_UNDERFLOW,    // OP_00EE with an empty stack
+	DIAG_OUT_OF_RANGE,       // Memory, fetch or keypad access past the end, wrapped around
+	DIAG_KIND_COUNT
+};
+
+enum DiagnosticPolicy : uint8_t
+{
+	POLICY_IGNORE = 0, // Count, log and keep running
+	POLICY_HALT,       // Count, log and stop the machine for good
+	POLICY_TRAP        // Count, log and pause the machine in the debugger
+};
+
+struct DiagnosticEvent
+{
+	uint64_t cycle;
+	uint16_t pc;
+	uint16_t opcode;
+	uint16_t address;
+	DiagnosticKind kind;
+};
+
+const unsigned int DIAGNOSTIC_QUEUE_SIZE = 1024;
+
+const char* diagnosticName(DiagnosticKind kind);
+
+// Collects problems the core runs into. report() only bumps a counter and
+// pushes onto a lock-free single-producer queue, so a ROM hitting the same
+// error every cycle costs almost nothing; a background thread drains the
+// queue and prints at most maxLinesPerSecond lines.
+class Diagnostics
+{
+public:
+	Diagnostics();
+	~Diagnostics();
+
+	void start();
+	void stop();
+
+	// Called from the emulation thread; returns the policy for this kind
+	DiagnosticPolicy report(DiagnosticKind kind, uint64_t cycle, uint16_t pc, uint16_t opcode, uint16_t address);
+	void setPolicy(DiagnosticPolicy policy);
+public:
+	DiagnosticPolicy policies[DIAG_KIND_COUNT];
+	std::atomic<uint64_t> counts[DIAG_KIND_COUNT];
+	std::atomic<uint64_t> dropped;
+	std::atomic<uint64_t> suppressed;
+	unsigned int maxLinesPerSecond{ 20 };
+private:
+	void drain();
+private:
+	DiagnosticEvent queue[DIAGNOSTIC_QUEUE_SIZE];
+	std::atomic<unsigned int> head;
+	std::atomic<unsigned int> tail;
+	std::atomic<bool> running;
+	std::thread worker;
+};
@@ -0,0 +1,78 @@
+#include "Disassembler.h"
+
+#include <cstdio>
+
+std::string disassembleOpcode(uint16_t opcode)
+{
+	unsigned int X = (opcode >> 8u) & 0x0Fu;
+	unsigned int Y = (opcode >> 4u) & 0x0Fu;
+	unsigned int N = opcode & 0x000Fu;
+	unsigned int NN = opcode & 0x00FFu;
+	unsigned int NNN = opcode & 0x0FFFu;
+
+	char text[32];
+
+	switch (opcode & 0xF000u)
+	{
+	case 0x0000u:
+		// Decoded on the low nibble alone, the same way Chip8::execute dispatches
+		if (N == 0x0u)
+			return "CLS";
+		if (N == 0xEu)
+			return "RET";
+		snprintf(text, sizeof(text), "SYS 0x%03X", NNN);
+		break;
+	case 0x1000u: snprintf(text, sizeof(text), "JP 0x%03X", NNN); break;
+	case 0x2000u: snprintf(text, sizeof(text), "CALL 0x%03X", NNN); break;
+	case 0x3000u: snprintf(text, sizeof(text), "SE V%X, 0x%02X", X, NN); break;
+	case 0x4000u: snprintf(text, sizeof(text), "SNE V%X, 0x%02X", X, NN); break;
+	case 0x5000u: snprintf(text, sizeof(text), "SE V%X, V%X", X, Y); break;
+	case 0x6000u: snprintf(text, sizeof(text), "LD V%X, 0x%02X", X, NN); break;
+	case 0x7000u: snprintf(text, sizeof(text), "ADD V%X, 0x%02X", X, NN); break;
+	case 0x8000u:
+		switch (N)
+		{
+		case 0x0u: snprintf(text, sizeof(text), "LD V%X, V%X", X, Y); break;
+		case 0x1u: snprintf(text, sizeof(text), "OR V%X, V%X", X, Y); break;
+		case 0x2u: snprintf(text, sizeof(text), "AND V%X, V%X", X, Y); break;
+		case 0x3u: snprintf(text, sizeof(text), "XOR V%X, V%X", X, Y); break;
+		case 0x4u: snprintf(text, sizeof(text), "ADD V%X, V%X", X, Y); break;
+		case 0x5u: snprintf(text, sizeof(text), "SUB V%X, V%X", X, Y); break;
+		case 0x6u: snprintf(text, sizeof(text), "SHR V%X, V%X", X, Y); break;
+		case 0x7u: snprintf(text, sizeof(text), "SUBN V%X, V%X", X, Y); break;
+		case 0xEu: snprintf(text, sizeof(text), "SHL V%X, V%X", X, Y); break;
+		default: snprintf(text, sizeof(text), "DW 0x%04X", opcode); break;
+		}
+		break;
+	case 0x9000u: snprintf(text, sizeof(text), "SNE V%X, V%X", X, Y); break;
+	case 0xA000u: snprintf(text, sizeof(text), "LD I, 0x%03X", NNN); break;
+	case 0xB000u: snprintf(text, sizeof(text), "JP V0, 0x%03X", NNN); break;
+	case 0xC000u: snprintf(text, sizeof(text), "RND V%X, 0x%02X", X, NN); break;
+	case 0xD000u: snprintf(text, sizeof(text), "DRW V%X, V%X, %u", X, Y, N); break;
+	case 0xE000u:
+		switch (NN)
+		{
+		case 0x9Eu: snprintf(text, sizeof(text), "SKP V%X", X); break;
+		case 0xA1u: snprintf(text, sizeof(text), "SKNP V%X", X); break;
+		default: snprintf(text, sizeof(text), "DW 0x%04X", opcode); break;
+		}
+		break;
+	case 0xF000u:
+		switch (NN)
+		{
+		case 0x07u: snprintf(text, sizeof(text), "LD V%X, DT", X); break;
+		case 0x0Au: snprintf(text, sizeof(text), "LD V%X, K", X); break;
+		case 0x15u: snprintf(text, sizeof(text), "LD DT, V%X", X); break;
+		case 0x18u: snprintf(text, sizeof(text), "LD ST, V%X", X); break;
+		case 0x1Eu: snprintf(text, sizeof(text), "ADD I, V%X", X); break;
+		case 0x29u: snprintf(text, sizeof(text), "LD F, V%X", X); break;
+		case 0x33u: snprintf(text, sizeof(text), "LD B, V%X", X); break;
+		case 0x55u: snprintf(text, sizeof(text), "LD [I], V%X", X); break;
+		case 0x65u: snprintf(text, sizeof(text), "LD V%X, [I]", X); break;
+		default: snprintf(text, sizeof(text), "DW 0x%04X", opcode); break;
+		}
+		break;
+	}
+
+	return text;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Formats a single opcode as CHIP-8 assembly, e.g. "LD V1, 0x2A"
+std::string disassembleOpcode(uint16_t opcode);
@@ -0,0 +1,68 @@
+#include "FileWatcher.h"
+
+#include <sys/stat.h>
+
+void FileWatcher::watch(const std::string& fileName)
+{
+	path = fileName;
+	pending = false;
+	lastPoll = std::chrono::steady_clock::now();
+	if (!readStamp(loadedModified, loadedSize))
+	{
+		loadedModified = loadedSize = -1;
+	}
+}
+
+bool FileWatcher::changed()
+{
+	if (path.empty())
+	{
+		return false;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	if (now - lastPoll < interval)
+	{
+		return false;
+	}
+	lastPoll = now;
+
+	long long modified = 0, size = 0;
+	if (!readStamp(modified, size) || (modified == loadedModified && size == loadedSize))
+	{
+		pending = false;
+		return false;
+	}
+
+	// Report the change on the first poll that sees the same stamp again
+	if (!pending || modified != pendingModified || size != pendingSize)
+	{
+		pending = true;
+		pendingModified = modified;
+		pendingSize = size;
+		return false;
+	}
+
+	pending = false;
+	loadedModified = modified;
+	loadedSize = size;
+	return true;
+}
+
+bool FileWatcher::readStamp(long long& modified, long long& size) const
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+	{
+		return false;
+	}
+
+	modified = static_cast<long long>(info.st_mtime) * 1000000000ll;
+#if defined(__APPLE__)
+	modified += info.st_mtimespec.tv_nsec;
+#else
+	modified += info.st_mtim.tv_nsec;
+#endif
+	size = static_cast<long long>(info.st_size);
+	return true;
+}
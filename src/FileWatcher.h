@@ -0,0 +1,28 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+// Polls a file's modification time and size so a ROM can be reloaded when it is
+// rebuilt. A change is only reported once the file has stopped changing for one
+// poll interval, so a half-written ROM is not picked up.
+class FileWatcher
+{
+public:
+	void watch(const std::string& fileName);
+	void stop() { path.clear(); }
+	bool isWatching() const { return !path.empty(); }
+
+	// Cheap to call every frame, the file is only checked every interval
+	bool changed();
+public:
+	std::chrono::milliseconds interval{ 250 };
+private:
+	bool readStamp(long long& modified, long long& size) const;
+private:
+	std::string path;
+	std::chrono::steady_clock::time_point lastPoll;
+	long long loadedModified{}, loadedSize{};
+	long long pendingModified{}, pendingSize{};
+	bool pending{};
+};
@@ -0,0 +1,68 @@
+#include "Fusion.h"
+
+#include <cstring>
+
+unsigned int fuseSuperinstructions(Chip8& chip8, const Analyzer& analyzer)
+{
+	memset(chip8.fusedOps, FUSED_NONE, sizeof(chip8.fusedOps));
+	memset(chip8.fusedLength, 0, sizeof(chip8.fusedLength));
+
+	unsigned int romEnd = PROGRAM_START_ADDRESS + analyzer.romSize;
+	unsigned int installed = 0;
+
+	// Only instructions the analyzer reached are fused, so data is never mistaken for code
+	auto isCode = [&](unsigned int address)
+	{
+		return address + 1 < romEnd && analyzer.byteType[address] == BYTE_CODE_START;
+	};
+	auto word = [&](unsigned int address) -> uint16_t
+	{
+		return chip8.memory[address] << 8u | chip8.memory[address + 1];
+	};
+
+	for (unsigned int address = PROGRAM_START_ADDRESS; address < romEnd; ++address)
+	{
+		if (!isCode(address) || !isCode(address + 2))
+		{
+			continue;
+		}
+
+		uint16_t first = word(address);
+		uint16_t second = word(address + 2);
+		uint8_t fused = FUSED_NONE;
+		uint8_t length = 2;
+
+		if ((first & 0xF0FFu) == 0xF007u && (second & 0xF000u) == 0x3000u &&
+			((first ^ second) & 0x0F00u) == 0 && isCode(address + 4) && (word(address + 4) & 0xF000u) == 0x1000u)
+		{
+			fused = FUSED_TIMER_WAIT;
+			length = 3;
+		}
+		else if ((first & 0xF000u) == 0xA000u && (second & 0xF000u) == 0xD000u)
+		{
+			fused = FUSED_ANNN_DXYN;
+		}
+		else if ((first & 0xF000u) == 0x7000u && (second & 0xF000u) == 0x3000u)
+		{
+			fused = FUSED_7XNN_3XNN;
+		}
+		else if ((first & 0xF000u) == 0x6000u && (second & 0xF000u) == 0x6000u)
+		{
+			fused = FUSED_6XNN_RUN;
+			while (length < MAX_FUSED_LENGTH && isCode(address + 2 * length) && (word(address + 2 * length) & 0xF000u) == 0x6000u)
+			{
+				++length;
+			}
+		}
+
+		if (fused != FUSED_NONE)
+		{
+			chip8.fusedOps[address] = fused;
+			chip8.fusedLength[address] = length;
+			++installed;
+		}
+	}
+
+	chip8.hasFusedOps = installed > 0;
+	return installed;
+}
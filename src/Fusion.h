@@ -0,0 +1,8 @@
+#pragma once
+
+#include "Chip8.h"
+#include "Analyzer.h"
+
+// Finds hot opcode sequences in the analyzed code and installs superinstructions for them in chip8.
+// Returns the number of superinstructions installed.
+unsigned int fuseSuperinstructions(Chip8& chip8, const Analyzer& analyzer);
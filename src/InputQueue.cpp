@@ -0,0 +1,53 @@
+#include "InputQueue.h"
+
+void InputQueue::push(uint8_t key, bool pressed)
+{
+	unsigned int next = (tail + 1) % INPUT_QUEUE_SIZE;
+	if (next == head)
+	{
+		++droppedEvents;
+		return;
+	}
+
+	InputEvent& event = events[tail];
+	event.hostTime = std::chrono::high_resolution_clock::now();
+	event.appliedCycle = 0;
+	event.key = key & 0x0Fu;
+	event.pressed = pressed;
+	tail = next;
+}
+
+void InputQueue::applyUntil(Chip8& chip8, std::chrono::high_resolution_clock::time_point emulatedTime)
+{
+	while (head != tail && events[head].hostTime <= emulatedTime)
+	{
+		InputEvent& event = events[head];
+		chip8.keypad[event.key] = event.pressed;
+		event.appliedCycle = chip8.cycleCount;
+		lastAppliedCycle = chip8.cycleCount;
+
+		if (appliedCount < INPUT_QUEUE_SIZE)
+		{
+			applied[appliedCount++] = event;
+		}
+		head = (head + 1) % INPUT_QUEUE_SIZE;
+	}
+}
+
+void InputQueue::framePresented(std::chrono::high_resolution_clock::time_point presentTime)
+{
+	for (unsigned int i = 0; i < appliedCount; ++i)
+	{
+		std::chrono::duration<float, std::milli> latency = presentTime - applied[i].hostTime;
+		lastLatencyMs = latency.count();
+		if (lastLatencyMs > maxLatencyMs)
+		{
+			maxLatencyMs = lastLatencyMs;
+		}
+
+		unsigned int bucket = static_cast<unsigned int>(lastLatencyMs / LATENCY_BUCKET_MS);
+		latencyHistogram[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1] += 1.0f;
+		++latencySamples;
+	}
+	appliedCount = 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "Chip8.h"
+
+const unsigned int INPUT_QUEUE_SIZE = 256;
+const unsigned int LATENCY_BUCKETS = 25;
+const float LATENCY_BUCKET_MS = 2.0f;
+
+struct InputEvent
+{
+	std::chrono::high_resolution_clock::time_point hostTime;
+	uint64_t appliedCycle;
+	uint8_t key;
+	bool pressed;
+};
+
+// Keypad events stamped with the host time they arrived at. The emulation
+// loop applies them between instructions, at the first cycle whose
+// emulated time reaches the stamp, and the latency from arrival to the
+// first presented frame that includes them is collected in a histogram.
+class InputQueue
+{
+public:
+	void push(uint8_t key, bool pressed);
+	bool hasPending() const { return head != tail; }
+
+	// Applies, in order, every queued event stamped at or before emulatedTime
+	void applyUntil(Chip8& chip8, std::chrono::high_resolution_clock::time_point emulatedTime);
+	// Records the input-to-present latency of every event applied since the previous frame
+	void framePresented(std::chrono::high_resolution_clock::time_point presentTime);
+public:
+	float latencyHistogram[LATENCY_BUCKETS]{};
+	float lastLatencyMs{};
+	float maxLatencyMs{};
+	uint64_t latencySamples{};
+	uint64_t droppedEvents{};
+	uint64_t lastAppliedCycle{};
+private:
+	InputEvent events[INPUT_QUEUE_SIZE];
+	unsigned int head{};
+	unsigned int tail{};
+
+	InputEvent applied[INPUT_QUEUE_SIZE];
+	unsigned int appliedCount{};
+};
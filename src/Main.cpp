@@ -1,7 +1,20 @@
 ﻿#include <chrono>
+#include <cstring>
+#include <string>
 
 #include "Chip8.h"
 #include "Window.h"
+#include "Analyzer.h"
+#include "Fusion.h"
+#include "TraceRecorder.h"
+#include "SharedState.h"
+#include "RunAhead.h"
+#include "InputQueue.h"
+#include "Diagnostics.h"
+#include "AotModule.h"
+#include "FileWatcher.h"
+#include "Telemetry.h"
+#include "Netplay.h"
 
 const int TIMER_RATE = 60;
 const auto TIMER_PERIOD = std::chrono::microseconds(1000000 / TIMER_RATE);
@@ -9,9 +22,26 @@ const int  DISPLAY_SIZE = DISPLAY_WIDTH * DISPLAY_HEIGHT;
 
 int main(int argc, char* argv[])
 {
-	if (argc != 4)
+	if (argc < 4)
 	{
-		std::cerr << "Usage: " << argv[0] << " <Video Scale> <Cycle Rate> <ROM>\n";
+		std::cerr << "Usage: " << argv[0] << " <Video Scale> <Cycle Rate> <ROM> [Options]\n"
+			<< "Options:\n"
+			<< "  --trace <File>           Record every executed instruction to File\n"
+			<< "  --trace-size <Records>   Number of most recent instructions kept (default 1048576)\n"
+			<< "  --shm <Name>             Publish machine state and read keypad input through POSIX shared memory\n"
+			<< "  --wrap-sprites           Wrap sprites around the screen edges instead of clipping them\n"
+			<< "  --fuse                   Run hot opcode sequences as superinstructions (ignored while tracing)\n"
+			<< "  --aot <Library>          Run the ROM's code from a shared library built with Chip8Recompile\n"
+			<< "  --watch                  Reload the ROM whenever the file changes\n"
+			<< "  --telemetry <File>       Write per-frame timings to File on exit, CSV if it ends in .csv, JSON otherwise\n"
+			<< "  --timing <fixed|vip>     fixed: <Cycle Rate> instructions per second (default)\n"
+			<< "                           vip: COSMAC VIP instruction timing and display wait, <Cycle Rate> is ignored\n"
+			<< "  --run-ahead <Frames>     Present the frame this many frames ahead to hide the ROM's input delay\n"
+			<< "  --netplay <Port> <Peer>  Play against Peer (host:port) over UDP with rollback, both sides need the same\n"
+			<< "                           ROM, <Cycle Rate>, timing, quirks and seed\n"
+			<< "  --seed <N>               Seed for the CXNN random number generator (default 1)\n"
+			<< "  --on-error <Policy>      ignore: log and continue (default), halt: stop the machine,\n"
+			<< "                           trap: pause in the debugger on invalid opcodes, stack or memory errors\n";
 		return 1;
 	}
 
@@ -19,12 +49,186 @@ int main(int argc, char* argv[])
 	int cycleRate = std::atoi(argv[2]);
 	char const* romFilename = argv[3];
 
+	char const* traceFilename = nullptr;
+	uint32_t traceSize = 1u << 20;
+	char const* sharedMemoryName = nullptr;
+	Chip8Quirks quirks;
+	bool fuse = false;
+	char const* aotFilename = nullptr;
+	bool watchROM = false;
+	char const* telemetryFilename = nullptr;
+	TimingMode timingMode = TIMING_FIXED_RATE;
+	int runAheadFrames = 0;
+	int netplayPort = 0;
+	char const* netplayPeer = nullptr;
+	uint32_t randomSeed = 1;
+	DiagnosticPolicy errorPolicy = POLICY_IGNORE;
+
+	for (int i = 4; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+		{
+			traceFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--trace-size") == 0 && i + 1 < argc)
+		{
+			int records = std::atoi(argv[++i]);
+			if (records <= 0)
+			{
+				std::cerr << "Invalid trace size: " << argv[i] << std::endl;
+				return 1;
+			}
+			traceSize = static_cast<uint32_t>(records);
+		}
+		else if (std::strcmp(argv[i], "--shm") == 0 && i + 1 < argc)
+		{
+			sharedMemoryName = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--wrap-sprites") == 0)
+		{
+			quirks.wrapSprites = true;
+		}
+		else if (std::strcmp(argv[i], "--fuse") == 0)
+		{
+			fuse = true;
+		}
+		else if (std::strcmp(argv[i], "--aot") == 0 && i + 1 < argc)
+		{
+			aotFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--watch") == 0)
+		{
+			watchROM = true;
+		}
+		else if (std::strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc)
+		{
+			telemetryFilename = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--timing") == 0 && i + 1 < argc)
+		{
+			++i;
+			if (std::strcmp(argv[i], "vip") == 0)
+			{
+				timingMode = TIMING_COSMAC_VIP;
+			}
+			else if (std::strcmp(argv[i], "fixed") != 0)
+			{
+				std::cerr << "Unknown timing mode: " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (std::strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc)
+		{
+			runAheadFrames = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--netplay") == 0 && i + 2 < argc)
+		{
+			netplayPort = std::atoi(argv[++i]);
+			netplayPeer = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+		{
+			randomSeed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+		}
+		else if (std::strcmp(argv[i], "--on-error") == 0 && i + 1 < argc)
+		{
+			++i;
+			if (std::strcmp(argv[i], "ignore") == 0)
+				errorPolicy = POLICY_IGNORE;
+			else if (std::strcmp(argv[i], "halt") == 0)
+				errorPolicy = POLICY_HALT;
+			else if (std::strcmp(argv[i], "trap") == 0)
+				errorPolicy = POLICY_TRAP;
+			else
+			{
+				std::cerr << "Unknown error policy: " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else
+		{
+			std::cerr << "Unknown option: " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+
 	const auto CHIP8_CYCLE_PERIOD = std::chrono::microseconds(1000000 / cycleRate);
+	const unsigned int INSTRUCTIONS_PER_FRAME = (cycleRate + TIMER_RATE - 1) / TIMER_RATE;
 
 	Chip8 myChip8;
+	myChip8.quirks = quirks;
+	myChip8.timingMode = timingMode;
+	myChip8.seedRandom(randomSeed);
+
+	Diagnostics diagnostics;
+	diagnostics.setPolicy(errorPolicy);
+	diagnostics.start();
+	myChip8.diagnostics = &diagnostics;
 	Window window(DISPLAY_WIDTH * videoScale, DISPLAY_HEIGHT * videoScale, "CHIP-8 Emulator", &myChip8);
 
+	std::string currentROM = romFilename;
 	myChip8.loadROM(romFilename);
+	window.setROMStatus(currentROM, 0.0f);
+	window.setWatchROM(watchROM);
+
+	FileWatcher romWatcher;
+	romWatcher.watch(currentROM);
+
+	Analyzer analyzer;
+	analyzer.analyze(myChip8, ".chip8cache");
+	window.setAnalyzer(&analyzer);
+
+	if (fuse)
+	{
+		std::cout << "Fused " << fuseSuperinstructions(myChip8, analyzer) << " superinstructions" << std::endl;
+	}
+
+	AotModule aot;
+	if (aotFilename)
+	{
+		aot.load(aotFilename, myChip8);
+	}
+
+	TraceRecorder tracer;
+	if (traceFilename && tracer.open(traceFilename, traceSize))
+	{
+		myChip8.tracer = &tracer;
+	}
+
+	SharedState sharedState;
+	if (sharedMemoryName)
+	{
+		sharedState.open(sharedMemoryName);
+	}
+
+	// Netplay reads the keypad once per frame, so keys go straight to it instead of through the queue
+	static RollbackSession netplay;
+	if (netplayPeer && netplay.open(static_cast<uint16_t>(netplayPort), netplayPeer, myChip8, INSTRUCTIONS_PER_FRAME))
+	{
+		window.setNetplay(&netplay);
+		if (runAheadFrames > 0)
+		{
+			std::cerr << "Warning: --run-ahead is ignored during netplay" << std::endl;
+			runAheadFrames = 0;
+		}
+	}
+
+	InputQueue inputQueue;
+	if (!netplay.isOpen())
+	{
+		window.setInputQueue(&inputQueue);
+	}
+	window.setDiagnostics(&diagnostics);
+
+	// Large ring, keep it off the stack
+	static Telemetry telemetry;
+	window.setTelemetry(&telemetry);
+
+	RunAhead runAhead(runAheadFrames);
+	if (runAheadFrames > 0)
+	{
+		window.setRunAhead(&runAhead);
+	}
 
 	auto lastCycleTime = std::chrono::high_resolution_clock::now();
 
@@ -34,14 +238,134 @@ int main(int argc, char* argv[])
 	const int texture = *(window.getTexture());
 	const int vao = *(window.getVAO());
 
+	// Swaps ROMs in place: the window, GL resources and ImGui stay as they are
+	auto switchROM = [&](const std::string& fileName)
+	{
+		if (netplay.isOpen())
+		{
+			std::cerr << "Warning: ROM switching is disabled during netplay" << std::endl;
+			return;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		if (!myChip8.loadROM(fileName.c_str()))
+		{
+			return;
+		}
+
+		// A compiled module stays valid for the same ROM (restart, watch reload of an unchanged
+		// file), superinstructions are rebuilt for whatever was loaded
+		if (aot.isLoaded() && aot.romHash != Analyzer::hashROM(myChip8.memory + PROGRAM_START_ADDRESS, myChip8.romSize))
+		{
+			aot.unload(myChip8);
+		}
+		analyzer.analyze(myChip8, ".chip8cache");
+		if (fuse)
+		{
+			fuseSuperinstructions(myChip8, analyzer);
+		}
+
+		// reset() started cycleCount over, so does the trace; TraceDiff needs increasing cycles
+		if (tracer.isOpen() && !tracer.open(traceFilename, traceSize))
+		{
+			myChip8.tracer = nullptr;
+		}
+
+		currentROM = fileName;
+		romWatcher.watch(currentROM);
+
+		lastCycleTime = std::chrono::high_resolution_clock::now();
+		lastTimerTime = lastCycleTime;
+
+		std::chrono::duration<float, std::micro> swapTime = lastCycleTime - start;
+		window.setROMStatus(currentROM, swapTime.count());
+	};
+
 	while (!window.shouldClose())
 	{
+		telemetry.beginFrame();
+		uint32_t frameInstructions = 0;
+		uint32_t catchUpIterations = 0;
+
+		// Poll before emulating so this frame already sees the input
+		window.pollEvents();
+
+		std::string requestedROM;
+		if (window.takeROMRequest(requestedROM))
+		{
+			switchROM(requestedROM);
+		}
+		else if (window.isWatchingROM() && romWatcher.changed())
+		{
+			switchROM(currentROM);
+		}
+
+		if (sharedState.isOpen())
+		{
+			sharedState.pollInput(myChip8);
+		}
+
 		auto now = std::chrono::high_resolution_clock::now();
-		while (now - lastCycleTime > CHIP8_CYCLE_PERIOD)
+		if (myChip8.runState != RUN_RUNNING)
 		{
-			myChip8.emulateCycle();
-			lastCycleTime += CHIP8_CYCLE_PERIOD;
+			// Halted or trapped: keep the clocks current so resuming does not replay the pause
+			lastCycleTime = now;
+			lastTimerTime = now;
 		}
+		else if (netplay.isOpen())
+		{
+			// Whole frames only, rollback snapshots are taken at frame boundaries
+			while (now - lastTimerTime > TIMER_PERIOD)
+			{
+				if (!netplay.advanceFrame(myChip8))
+				{
+					// Waiting for the peer: drop the time instead of bursting once it catches up
+					lastTimerTime = now;
+					break;
+				}
+				frameInstructions += netplay.lastFrameInstructions;
+				lastTimerTime += TIMER_PERIOD;
+				++catchUpIterations;
+			}
+		}
+		else if (myChip8.timingMode == TIMING_COSMAC_VIP)
+		{
+			// The cost model decides how many instructions fit in each 60 Hz frame
+			while (now - lastTimerTime > TIMER_PERIOD)
+			{
+				inputQueue.applyUntil(myChip8, lastTimerTime);
+				frameInstructions += myChip8.runFrame(0);
+				lastTimerTime += TIMER_PERIOD;
+				++catchUpIterations;
+			}
+		}
+		else
+		{
+			while (now - lastCycleTime > CHIP8_CYCLE_PERIOD)
+			{
+				if (inputQueue.hasPending())
+				{
+					inputQueue.applyUntil(myChip8, lastCycleTime);
+				}
+				unsigned int retired = aot.isLoaded() ? aot.step(myChip8) : myChip8.step();
+				lastCycleTime += CHIP8_CYCLE_PERIOD * retired;
+				frameInstructions += retired;
+				++catchUpIterations;
+			}
+		}
+
+		if (sharedState.isOpen())
+		{
+			sharedState.publish(myChip8);
+		}
+
+		const uint32_t* presentedDisplay = myChip8.display;
+		if (runAheadFrames > 0)
+		{
+			runAhead.run(myChip8, INSTRUCTIONS_PER_FRAME);
+			presentedDisplay = runAhead.getDisplay();
+		}
+		telemetry.endPhase(PHASE_EMULATION);
 
 		window.clear();
 		glBindTexture(GL_TEXTURE_2D, texture);
@@ -51,7 +375,7 @@ int main(int argc, char* argv[])
 		{
 			for (int x = 0; x < 64; x++)
 			{
-				flippedDisplay[x + (31 - y) * 64] = myChip8.display[x + y * 64];
+				flippedDisplay[x + (31 - y) * 64] = presentedDisplay[x + y * 64];
 			}
 		}
 
@@ -62,9 +386,19 @@ int main(int argc, char* argv[])
 		glDrawArrays(GL_TRIANGLES, 0, 6);
 		glBindVertexArray(0);
 		glBindTexture(GL_TEXTURE_2D, 0);
+		telemetry.endPhase(PHASE_UPLOAD);
 
 		window.renderImGui();
+		telemetry.endPhase(PHASE_IMGUI);
 		window.update();
+		telemetry.endPhase(PHASE_SWAP);
+		inputQueue.framePresented(std::chrono::high_resolution_clock::now());
+		telemetry.endFrame(frameInstructions, catchUpIterations);
+	}
+
+	if (telemetryFilename)
+	{
+		telemetry.write(telemetryFilename);
 	}
 
 	delete[] flippedDisplay;
@@ -0,0 +1,343 @@
+#include "Netplay.h"
+#include "Analyzer.h"
+#include "StateHash.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+RollbackSession::~RollbackSession()
+{
+	close();
+}
+
+bool RollbackSession::open(uint16_t localPort, const char* peer, const Chip8& chip8, unsigned int instructionsPerFrame)
+{
+	close();
+
+	std::string peerName = peer;
+	size_t colon = peerName.find_last_of(':');
+	if (colon == std::string::npos)
+	{
+		std::cerr << "Error: Netplay peer must be host:port: " << peer << std::endl;
+		return false;
+	}
+
+	addrinfo hints{};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	addrinfo* result = nullptr;
+	if (getaddrinfo(peerName.substr(0, colon).c_str(), peerName.substr(colon + 1).c_str(), &hints, &result) != 0 || !result)
+	{
+		std::cerr << "Error: Failed to resolve netplay peer: " << peer << std::endl;
+		return false;
+	}
+	memcpy(&peerAddress, result->ai_addr, sizeof(peerAddress));
+	freeaddrinfo(result);
+
+	// Listen only on the interface that routes to the peer, loopback for a peer on the same machine
+	sockaddr_in localAddress{};
+	socklen_t localSize = sizeof(localAddress);
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	bool routed = fd >= 0 && connect(fd, reinterpret_cast<const sockaddr*>(&peerAddress), sizeof(peerAddress)) == 0 &&
+		getsockname(fd, reinterpret_cast<sockaddr*>(&localAddress), &localSize) == 0;
+	if (fd >= 0)
+	{
+		::close(fd);
+	}
+	if (!routed)
+	{
+		std::cerr << "Error: No route to netplay peer: " << peer << std::endl;
+		return false;
+	}
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+	{
+		std::cerr << "Error: Failed to create netplay socket" << std::endl;
+		return false;
+	}
+
+	// Connecting makes the kernel drop datagrams from anyone but the peer
+	localAddress.sin_port = htons(localPort);
+	if (bind(fd, reinterpret_cast<sockaddr*>(&localAddress), sizeof(localAddress)) != 0 ||
+		connect(fd, reinterpret_cast<const sockaddr*>(&peerAddress), sizeof(peerAddress)) != 0 ||
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) != 0)
+	{
+		std::cerr << "Error: Failed to bind netplay port " << localPort << std::endl;
+		::close(fd);
+		return false;
+	}
+	socketFd = fd;
+
+	// Both sides must run the same program at the same speed from the same random seed
+	sessionHash = Analyzer::hashROM(chip8.memory + PROGRAM_START_ADDRESS, chip8.romSize);
+	sessionHash = mixHash(sessionHash ^ chip8.randomSeed);
+	sessionHash = mixHash(sessionHash ^ instructionsPerFrame ^ chip8.timingMode << 16u ^ chip8.quirks.wrapSprites << 24u);
+	this->instructionsPerFrame = instructionsPerFrame;
+
+	std::cout << "Netplay on port " << localPort << " with peer " << peer << std::endl;
+	return true;
+}
+
+void RollbackSession::close()
+{
+	if (socketFd < 0)
+	{
+		return;
+	}
+
+	::close(socketFd);
+	socketFd = -1;
+}
+
+bool RollbackSession::advanceFrame(Chip8& chip8)
+{
+	// The keypad holds the local keys between frames and local plus remote keys while running
+	uint16_t localKeys = 0;
+	for (unsigned int key = 0; key < 16; ++key)
+	{
+		localKeys |= chip8.keypad[key] ? 1u << key : 0u;
+	}
+
+	receive();
+
+	// Frames that ran on a guess run again once their inputs are confirmed, even if the
+	// guess was right, so the trace and diagnostics see every final frame exactly once
+	uint32_t replayFrame = needsRollback ? rollbackFrame : frame;
+	if (confirmedFrame > finalFrame)
+	{
+		replayFrame = std::min(replayFrame, finalFrame);
+	}
+
+	if (replayFrame < frame)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		chip8.loadState(snapshots[replayFrame % NETPLAY_HISTORY]);
+		for (uint32_t past = replayFrame; past < frame; ++past)
+		{
+			runFrame(chip8, past, localInputs[past % NETPLAY_HISTORY]);
+		}
+		resimulatedFrames += frame - replayFrame;
+
+		if (needsRollback)
+		{
+			std::chrono::duration<float, std::milli> cost = std::chrono::high_resolution_clock::now() - start;
+			++rollbacks;
+			maxRollbackFrames = std::max(maxRollbackFrames, frame - rollbackFrame);
+			lastRollbackMs = cost.count();
+			maxRollbackMs = std::max(maxRollbackMs, lastRollbackMs);
+		}
+	}
+	needsRollback = false;
+
+	updateChecksums();
+	compareChecksums();
+
+	bool advanced = frame < confirmedFrame + NETPLAY_MAX_PREDICTION;
+	if (advanced)
+	{
+		runFrame(chip8, frame, localKeys);
+		++frame;
+	}
+	else
+	{
+		// Snapshots only reach back so far, wait for the peer to catch up
+		++stalls;
+	}
+	send();
+
+	for (unsigned int key = 0; key < 16; ++key)
+	{
+		chip8.keypad[key] = (localKeys >> key) & 1u;
+	}
+	return advanced;
+}
+
+void RollbackSession::runFrame(Chip8& chip8, uint32_t runFrame, uint16_t localKeys)
+{
+	unsigned int slot = runFrame % NETPLAY_HISTORY;
+	chip8.saveState(snapshots[slot]);
+	snapshotHashes[slot] = chip8.stateHash();
+	snapshotFrames[slot] = runFrame;
+	localInputs[slot] = localKeys;
+
+	uint16_t keys = localKeys | remoteInput(runFrame);
+	predictedInputs[slot] = remoteInput(runFrame);
+	for (unsigned int key = 0; key < 16; ++key)
+	{
+		chip8.keypad[key] = (keys >> key) & 1u;
+	}
+
+	// A frame on predicted input may still be rolled back, it stays out of the trace, the diagnostics
+	// and the memory viewer's heat
+	TraceRecorder* tracer = chip8.tracer;
+	Diagnostics* diagnostics = chip8.diagnostics;
+	if (runFrame < confirmedFrame)
+	{
+		finalFrame = runFrame + 1;
+	}
+	else
+	{
+		chip8.tracer = nullptr;
+		chip8.diagnostics = nullptr;
+		chip8.speculative = true;
+	}
+
+	lastFrameInstructions = chip8.runFrame(instructionsPerFrame);
+
+	chip8.tracer = tracer;
+	chip8.diagnostics = diagnostics;
+	chip8.speculative = false;
+}
+
+uint16_t RollbackSession::remoteInput(uint32_t runFrame) const
+{
+	unsigned int slot = runFrame % NETPLAY_HISTORY;
+	if (remoteValid[slot] && remoteFrames[slot] == runFrame)
+	{
+		return remoteInputs[slot];
+	}
+
+	// Predict that the peer keeps holding whatever it held last
+	if (confirmedFrame == 0)
+	{
+		return 0;
+	}
+	return remoteInputs[(confirmedFrame - 1) % NETPLAY_HISTORY];
+}
+
+void RollbackSession::receive()
+{
+	NetplayPacket packet;
+	while (true)
+	{
+		ssize_t size = recv(socketFd, &packet, sizeof(packet), 0);
+		if (size < 0)
+		{
+			break;
+		}
+		if (static_cast<size_t>(size) < offsetof(NetplayPacket, inputs) || packet.magic != NETPLAY_MAGIC ||
+			packet.version != NETPLAY_VERSION || packet.inputCount > NETPLAY_HISTORY ||
+			static_cast<size_t>(size) < offsetof(NetplayPacket, inputs) + packet.inputCount * sizeof(uint16_t))
+		{
+			continue;
+		}
+		if (packet.sessionHash != sessionHash)
+		{
+			if (!warnedSession)
+			{
+				std::cerr << "Error: Netplay peer runs a different ROM, seed or speed" << std::endl;
+				warnedSession = true;
+			}
+			continue;
+		}
+
+		peerAckFrame = std::max(peerAckFrame, packet.ackFrame);
+		if (packet.checksumFrame > remoteChecksumFrame)
+		{
+			remoteChecksumFrame = packet.checksumFrame;
+			remoteChecksum = packet.checksum;
+		}
+
+		for (unsigned int i = 0; i < packet.inputCount; ++i)
+		{
+			uint32_t inputFrame = packet.firstFrame + i;
+			unsigned int slot = inputFrame % NETPLAY_HISTORY;
+			if (inputFrame < confirmedFrame || inputFrame >= confirmedFrame + NETPLAY_HISTORY ||
+				(remoteValid[slot] && remoteFrames[slot] == inputFrame))
+			{
+				continue;
+			}
+
+			remoteInputs[slot] = packet.inputs[i];
+			remoteFrames[slot] = inputFrame;
+			remoteValid[slot] = true;
+
+			// A frame that already ran on a wrong guess has to run again
+			if (inputFrame < frame && predictedInputs[slot] != packet.inputs[i])
+			{
+				rollbackFrame = needsRollback ? std::min(rollbackFrame, inputFrame) : inputFrame;
+				needsRollback = true;
+			}
+		}
+
+		while (remoteValid[confirmedFrame % NETPLAY_HISTORY] && remoteFrames[confirmedFrame % NETPLAY_HISTORY] == confirmedFrame)
+		{
+			++confirmedFrame;
+		}
+	}
+}
+
+void RollbackSession::send()
+{
+	NetplayPacket packet;
+	memset(&packet, 0, sizeof(packet));
+	packet.magic = NETPLAY_MAGIC;
+	packet.version = NETPLAY_VERSION;
+	packet.sessionHash = sessionHash;
+	packet.ackFrame = confirmedFrame;
+	packet.checksumFrame = checksumFrame;
+	packet.checksum = checksums[(checksumFrame / NETPLAY_CHECKSUM_INTERVAL) % 4];
+
+	// Everything the peer has not acknowledged, as far back as the history goes
+	uint32_t first = std::max(peerAckFrame, frame > NETPLAY_HISTORY ? frame - NETPLAY_HISTORY : 0u);
+	first = std::min(first, frame);
+	packet.firstFrame = first;
+	packet.inputCount = static_cast<uint16_t>(frame - first);
+	for (uint32_t i = 0; i < packet.inputCount; ++i)
+	{
+		packet.inputs[i] = localInputs[(first + i) % NETPLAY_HISTORY];
+	}
+
+	size_t size = offsetof(NetplayPacket, inputs) + packet.inputCount * sizeof(uint16_t);
+	::send(socketFd, &packet, size, 0);
+}
+
+void RollbackSession::updateChecksums()
+{
+	// The start state of a frame is final once every remote input before it has arrived
+	uint32_t latest = std::min(confirmedFrame, frame > 0 ? frame - 1 : 0u);
+	uint32_t candidate = latest - latest % NETPLAY_CHECKSUM_INTERVAL;
+	unsigned int slot = candidate % NETPLAY_HISTORY;
+	if (candidate == 0 || candidate <= checksumFrame || snapshotFrames[slot] != candidate)
+	{
+		return;
+	}
+
+	checksumFrame = candidate;
+	unsigned int index = (candidate / NETPLAY_CHECKSUM_INTERVAL) % 4;
+	checksumFrames[index] = candidate;
+	checksums[index] = snapshotHashes[slot];
+}
+
+void RollbackSession::compareChecksums()
+{
+	if (remoteChecksumFrame <= lastComparedFrame)
+	{
+		return;
+	}
+
+	unsigned int index = (remoteChecksumFrame / NETPLAY_CHECKSUM_INTERVAL) % 4;
+	if (checksumFrames[index] != remoteChecksumFrame)
+	{
+		return;
+	}
+
+	lastComparedFrame = remoteChecksumFrame;
+	if (checksums[index] != remoteChecksum)
+	{
+		if (desyncs == 0)
+		{
+			std::cerr << "Error: Netplay desync detected at frame " << remoteChecksumFrame << std::endl;
+		}
+		++desyncs;
+	}
+}
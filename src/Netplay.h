@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <netinet/in.h>
+
+#include "Chip8.h"
+
+const uint32_t NETPLAY_MAGIC = 0x504E3843; // "C8NP"
+const uint16_t NETPLAY_VERSION = 1;
+const unsigned int NETPLAY_MAX_PREDICTION = 12;  // Frames run ahead of the last confirmed remote input
+const unsigned int NETPLAY_HISTORY = 32;         // Frames of inputs and snapshots kept, > 2 * NETPLAY_MAX_PREDICTION
+const unsigned int NETPLAY_CHECKSUM_INTERVAL = 30;
+
+// One datagram in host byte order, sent every frame. Inputs are resent until the
+// peer acknowledges them, so a lost packet only delays confirmation.
+struct NetplayPacket
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t inputCount;
+	uint64_t sessionHash;      // ROM, seed and speed; peers with different settings ignore each other
+	uint32_t firstFrame;       // Frame of inputs[0]
+	uint32_t ackFrame;         // Every remote input before this frame has arrived
+	uint32_t checksumFrame;    // Latest frame whose start state is final, 0 if none yet
+	uint32_t reserved;
+	uint64_t checksum;         // Chip8::stateHash() at the start of checksumFrame
+	uint16_t inputs[NETPLAY_HISTORY];  // Keypad masks, bit N = key N down
+};
+
+// Rollback session between two emulators running the same ROM: every 60 Hz
+// frame runs immediately with the local keys and a prediction of the
+// peer's (its last known input). When the real input for an earlier frame
+// differs from the prediction, the snapshot taken at the start of that
+// frame is restored and the frames since are simulated again.
+//
+// Only frames run with the peer's real input are traced and reported to
+// the diagnostics, so a trace holds the confirmed history and can be diffed
+// against the peer's.
+class RollbackSession
+{
+public:
+	~RollbackSession();
+
+	// Binds localPort on the interface that routes to peer, given as host:port, and only
+	// exchanges datagrams with it
+	bool open(uint16_t localPort, const char* peer, const Chip8& chip8, unsigned int instructionsPerFrame);
+	void close();
+	bool isOpen() const { return socketFd >= 0; }
+
+	// Runs the next frame with chip8.keypad as the local input, rolling back first if needed.
+	// Returns false without running anything while the peer is too far behind to keep predicting.
+	bool advanceFrame(Chip8& chip8);
+public:
+	uint32_t frame{};                 // Next frame to run
+	uint32_t confirmedFrame{};        // Every remote input before this frame has arrived
+	uint64_t rollbacks{};
+	uint64_t resimulatedFrames{};     // After a misprediction, or to trace a frame once its guess is confirmed
+	uint32_t maxRollbackFrames{};
+	float lastRollbackMs{};
+	float maxRollbackMs{};
+	uint64_t stalls{};
+	uint64_t desyncs{};
+	uint32_t lastFrameInstructions{};
+private:
+	void receive();
+	void send();
+	void runFrame(Chip8& chip8, uint32_t runFrame, uint16_t localKeys);
+	uint16_t remoteInput(uint32_t runFrame) const;
+	void updateChecksums();
+	void compareChecksums();
+private:
+	int socketFd{ -1 };
+	sockaddr_in peerAddress{};
+	uint64_t sessionHash{};
+	unsigned int instructionsPerFrame{};
+	uint32_t peerAckFrame{};
+	uint32_t rollbackFrame{};
+	uint32_t finalFrame{};            // Every frame before this ran with confirmed inputs
+	bool needsRollback{};
+
+	// Indexed by frame % NETPLAY_HISTORY, each tagged with the frame it holds
+	uint16_t localInputs[NETPLAY_HISTORY]{};
+	uint16_t remoteInputs[NETPLAY_HISTORY]{};
+	uint32_t remoteFrames[NETPLAY_HISTORY]{};
+	bool remoteValid[NETPLAY_HISTORY]{};
+	uint16_t predictedInputs[NETPLAY_HISTORY]{};
+	Chip8State snapshots[NETPLAY_HISTORY];
+	uint64_t snapshotHashes[NETPLAY_HISTORY]{};
+	uint32_t snapshotFrames[NETPLAY_HISTORY]{};
+
+	// Own checksums of the last few intervals, indexed by (frame / NETPLAY_CHECKSUM_INTERVAL) % 4
+	uint32_t checksumFrames[4]{};
+	uint64_t checksums[4]{};
+	uint32_t checksumFrame{};
+	uint32_t remoteChecksumFrame{};
+	uint64_t remoteChecksum{};
+	uint32_t lastComparedFrame{};
+	bool warnedSession{};
+};
@@ -0,0 +1,39 @@
+#include "RunAhead.h"
+#include "TraceRecorder.h"
+
+#include <chrono>
+#include <cstring>
+
+RunAhead::RunAhead(int frames)
+	: frames(frames)
+{
+}
+
+void RunAhead::run(Chip8& chip8, unsigned int instructionsPerFrame)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Speculative instructions must not end up in the trace, the diagnostics or the memory
+	// viewer's heat, they only count once the real machine gets there
+	TraceRecorder* tracer = chip8.tracer;
+	Diagnostics* diagnostics = chip8.diagnostics;
+	chip8.tracer = nullptr;
+	chip8.diagnostics = nullptr;
+	chip8.speculative = true;
+
+	chip8.saveState(savedState);
+	for (int i = 0; i < frames; ++i)
+	{
+		chip8.runFrame(instructionsPerFrame);
+	}
+	memcpy(display, chip8.display, sizeof(display));
+	chip8.loadState(savedState);
+
+	chip8.tracer = tracer;
+	chip8.diagnostics = diagnostics;
+	chip8.speculative = false;
+
+	std::chrono::duration<float, std::milli> cost = std::chrono::high_resolution_clock::now() - start;
+	lastCostMs = cost.count();
+	averageCostMs += (lastCostMs - averageCostMs) * 0.05f;
+}
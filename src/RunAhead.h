@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Chip8.h"
+
+// Hides the ROM's own input delay: every display frame the machine is run
+// `frames` frames ahead with the current keypad, that speculative frame is
+// what gets presented, and the machine is restored to where it was.
+class RunAhead
+{
+public:
+	explicit RunAhead(int frames);
+
+	void run(Chip8& chip8, unsigned int instructionsPerFrame);
+	const uint32_t* getDisplay() const { return display; }
+public:
+	int frames;
+	float lastCostMs{};
+	float averageCostMs{};
+private:
+	Chip8State savedState;
+	uint32_t display[DISPLAY_WIDTH * DISPLAY_HEIGHT]{};
+};
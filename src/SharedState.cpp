@@ -0,0 +1,131 @@
+#include "SharedState.h"
+
+#include <cerrno>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+SharedState::~SharedState()
+{
+	close();
+}
+
+bool SharedState::open(const char* name)
+{
+	close();
+
+	if (strlen(name) >= sizeof(regionName))
+	{
+		std::cerr << "Error: Shared memory name is longer than " << sizeof(regionName) - 1 << " characters: " << name << std::endl;
+		return false;
+	}
+
+	// Only a region this process created is removed again, a controller may have created it first
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	created = fd >= 0;
+	if (!created && errno == EEXIST)
+	{
+		fd = shm_open(name, O_RDWR, 0644);
+	}
+	if (fd < 0)
+	{
+		std::cerr << "Error: Failed to open shared memory: " << name << std::endl;
+		return false;
+	}
+
+	if (ftruncate(fd, sizeof(SharedMachineState)) != 0)
+	{
+		std::cerr << "Error: Failed to size shared memory: " << name << std::endl;
+		::close(fd);
+		if (created)
+		{
+			shm_unlink(name);
+		}
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, sizeof(SharedMachineState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		std::cerr << "Error: Failed to map shared memory: " << name << std::endl;
+		if (created)
+		{
+			shm_unlink(name);
+		}
+		return false;
+	}
+
+	shared = static_cast<SharedMachineState*>(mapping);
+	strcpy(regionName, name);
+
+	// Keep the input channel if a controller created the region before us. Its keys may already
+	// be down, so treat the current generation as unseen and let the first poll copy the whole mask
+	lastKeypadGeneration = shared->keypadGeneration.load(std::memory_order_acquire) - 1u;
+	lastKeypadMask = 0;
+
+	shared->generation.store(0, std::memory_order_relaxed);
+	shared->version = SHARED_STATE_VERSION;
+	shared->magic = SHARED_STATE_MAGIC;
+
+	std::cout << "Publishing machine state to shared memory " << name << std::endl;
+	return true;
+}
+
+void SharedState::close()
+{
+	if (!shared)
+	{
+		return;
+	}
+
+	munmap(shared, sizeof(SharedMachineState));
+	if (created)
+	{
+		shm_unlink(regionName);
+	}
+	shared = nullptr;
+}
+
+void SharedState::publish(const Chip8& chip8)
+{
+	uint32_t generation = shared->generation.load(std::memory_order_relaxed);
+	shared->generation.store(generation + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	shared->frame = frame++;
+	shared->cycleCount = chip8.cycleCount;
+	shared->pc = chip8.pc;
+	shared->indexRegister = chip8.indexRegister;
+	memcpy(shared->stack, chip8.stack, sizeof(shared->stack));
+	memcpy(shared->registers, chip8.registers, sizeof(shared->registers));
+	shared->sp = chip8.sp;
+	shared->delayTimer = chip8.delayTimer;
+	shared->soundTimer = chip8.soundTimer;
+	memcpy(shared->display, chip8.display, sizeof(shared->display));
+
+	shared->generation.store(generation + 2, std::memory_order_release);
+}
+
+void SharedState::pollInput(Chip8& chip8)
+{
+	uint32_t generation = shared->keypadGeneration.load(std::memory_order_acquire);
+	if (generation == lastKeypadGeneration)
+	{
+		return;
+	}
+	lastKeypadGeneration = generation;
+
+	// Only touch keys the external writer changed, so the local keyboard keeps working
+	uint32_t mask = shared->keypadMask.load(std::memory_order_relaxed);
+	uint32_t changed = mask ^ lastKeypadMask;
+	for (unsigned int i = 0; i < 16; ++i)
+	{
+		if (changed & (1u << i))
+		{
+			chip8.keypad[i] = (mask >> i) & 1u;
+		}
+	}
+	lastKeypadMask = mask;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "Chip8.h"
+
+const uint32_t SHARED_STATE_MAGIC = 0x53533843; // "C8SS"
+const uint32_t SHARED_STATE_VERSION = 1;
+
+// Layout of the POSIX shared-memory region. The emulator publishes the
+// machine state once per frame under a seqlock; external processes own the
+// keypad input channel at the end.
+struct SharedMachineState
+{
+	uint32_t magic;
+	uint32_t version;
+
+	// Seqlock generation, odd while the emulator is writing
+	std::atomic<uint32_t> generation;
+	uint32_t frame;
+	uint64_t cycleCount;
+
+	uint16_t pc;
+	uint16_t indexRegister;
+	uint16_t stack[16];
+	uint8_t registers[16];
+	uint8_t sp;
+	uint8_t delayTimer;
+	uint8_t soundTimer;
+	uint8_t reserved;
+	uint32_t display[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+
+	// Input channel: writers update keypadMask (bit N = key N down) and then bump keypadGeneration
+	std::atomic<uint32_t> keypadGeneration;
+	std::atomic<uint32_t> keypadMask;
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Shared atomics must be plain 32-bit words");
+
+// Consistent copy of everything but the input channel, for readers. Never blocks the
+// emulator: returns false if a publish was in progress so the caller can retry.
+inline bool readSharedState(const SharedMachineState* shared, SharedMachineState* copy)
+{
+	uint32_t before = shared->generation.load(std::memory_order_acquire);
+	if (before & 1u)
+	{
+		return false;
+	}
+
+	memcpy(&copy->frame, &shared->frame, offsetof(SharedMachineState, keypadGeneration) - offsetof(SharedMachineState, frame));
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return shared->generation.load(std::memory_order_relaxed) == before;
+}
+
+// Owner side of the shared-memory region, used by the emulator
+class SharedState
+{
+public:
+	~SharedState();
+
+	bool open(const char* name);
+	void close();
+	bool isOpen() const { return shared != nullptr; }
+
+	// Copies the machine state into the region, called once per frame
+	void publish(const Chip8& chip8);
+	// Applies keys that external writers changed since the last poll; the first poll after
+	// open() applies every key the region already holds down
+	void pollInput(Chip8& chip8);
+private:
+	SharedMachineState* shared{};
+	char regionName[64]{};
+	bool created{};  // This process created the region and unlinks it on close
+	uint32_t frame{};
+	uint32_t lastKeypadGeneration{};
+	uint32_t lastKeypadMask{};
+};
@@ -0,0 +1,77 @@
+#include "StateHash.h"
+
+static size_t roundUpToPowerOfTwo(size_t capacity)
+{
+	size_t size = 1;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+	return size;
+}
+
+StateHashSet::StateHashSet(size_t capacity)
+	: overflowed(0), slots(roundUpToPowerOfTwo(capacity)), count(0), mask(slots.size() - 1)
+{
+	clear();
+}
+
+// 0 marks an empty slot, so it shares a key with 1
+static uint64_t slotKey(uint64_t hash)
+{
+	return hash ? hash : 1;
+}
+
+bool StateHashSet::insert(uint64_t hash)
+{
+	uint64_t key = slotKey(hash);
+	for (size_t probe = 0; probe <= mask; ++probe)
+	{
+		std::atomic<uint64_t>& slot = slots[(key + probe) & mask];
+		uint64_t current = slot.load(std::memory_order_acquire);
+		if (current == 0)
+		{
+			if (slot.compare_exchange_strong(current, key, std::memory_order_acq_rel))
+			{
+				count.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+			// Another worker claimed the slot first, current now holds its key
+		}
+		if (current == key)
+		{
+			return false;
+		}
+	}
+
+	overflowed.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+bool StateHashSet::contains(uint64_t hash) const
+{
+	uint64_t key = slotKey(hash);
+	for (size_t probe = 0; probe <= mask; ++probe)
+	{
+		uint64_t current = slots[(key + probe) & mask].load(std::memory_order_acquire);
+		if (current == key)
+		{
+			return true;
+		}
+		if (current == 0)
+		{
+			return false;
+		}
+	}
+	return false;
+}
+
+void StateHashSet::clear()
+{
+	for (std::atomic<uint64_t>& slot : slots)
+	{
+		slot.store(0, std::memory_order_relaxed);
+	}
+	count.store(0, std::memory_order_relaxed);
+	overflowed.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// splitmix64 finalizer; keyed by position it stands in for a Zobrist table,
+// which would need 8 MB for every (address, byte value) pair of memory
+inline uint64_t mixHash(uint64_t value)
+{
+	value += 0x9E3779B97F4A7C15ull;
+	value = (value ^ (value >> 30u)) * 0xBF58476D1CE4E5B9ull;
+	value = (value ^ (value >> 27u)) * 0x94D049BB133111EBull;
+	return value ^ (value >> 31u);
+}
+
+// Contribution of one memory byte, XORed in and out as it changes
+inline uint64_t memoryByteHash(uint16_t address, uint8_t value)
+{
+	return mixHash(static_cast<uint64_t>(address) << 8u | value);
+}
+
+// Contribution of one display row
+inline uint64_t displayRowHash(unsigned int y, uint64_t row)
+{
+	return mixHash(row ^ (y + 1u) * 0xD6E8FEB86659FD93ull);
+}
+
+// Set of state hashes shared by search workers. Lock-free open addressing with
+// linear probing; it never grows, so size the capacity for the whole search.
+class StateHashSet
+{
+public:
+	// Capacity is rounded up to a power of two
+	explicit StateHashSet(size_t capacity);
+
+	// True if the hash was not in the set yet. Once the table is full nothing
+	// more is stored and every hash counts as new, so the search stays complete.
+	bool insert(uint64_t hash);
+	bool contains(uint64_t hash) const;
+	// Not thread-safe, call while no worker is inserting
+	void clear();
+
+	size_t size() const { return count.load(std::memory_order_relaxed); }
+	size_t capacity() const { return slots.size(); }
+public:
+	std::atomic<uint64_t> overflowed;
+private:
+	std::vector<std::atomic<uint64_t>> slots;
+	std::atomic<size_t> count;
+	size_t mask;
+};
@@ -0,0 +1,273 @@
+#include "Telemetry.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+const char* telemetryMetricName(TelemetryMetric metric)
+{
+	switch (metric)
+	{
+	case METRIC_FRAME_MS: return "frame_ms";
+	case METRIC_EMULATION_MS: return "emulation_ms";
+	case METRIC_UPLOAD_MS: return "upload_ms";
+	case METRIC_IMGUI_MS: return "imgui_ms";
+	case METRIC_SWAP_MS: return "swap_ms";
+	case METRIC_INSTRUCTIONS: return "instructions";
+	case METRIC_CATCH_UP: return "catch_up_iterations";
+	default: return "unknown";
+	}
+}
+
+Telemetry::Telemetry()
+	: written(0)
+{
+}
+
+void Telemetry::beginFrame()
+{
+	frameStart = std::chrono::high_resolution_clock::now();
+	lastMark = frameStart;
+	memset(phaseMs, 0, sizeof(phaseMs));
+}
+
+void Telemetry::endPhase(TelemetryPhase phase)
+{
+	auto now = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<float, std::milli> elapsed = now - lastMark;
+	phaseMs[phase] += elapsed.count();
+	lastMark = now;
+}
+
+void Telemetry::endFrame(uint32_t instructions, uint32_t catchUpIterations)
+{
+	std::chrono::duration<float, std::milli> frameTime = std::chrono::high_resolution_clock::now() - frameStart;
+
+	uint64_t frame = written.load(std::memory_order_relaxed);
+	FrameSample& sample = ring[frame & (TELEMETRY_FRAMES - 1)];
+	sample.frame = frame;
+	sample.values[METRIC_FRAME_MS] = frameTime.count();
+	sample.values[METRIC_EMULATION_MS] = phaseMs[PHASE_EMULATION];
+	sample.values[METRIC_UPLOAD_MS] = phaseMs[PHASE_UPLOAD];
+	sample.values[METRIC_IMGUI_MS] = phaseMs[PHASE_IMGUI];
+	sample.values[METRIC_SWAP_MS] = phaseMs[PHASE_SWAP];
+	sample.values[METRIC_INSTRUCTIONS] = static_cast<float>(instructions);
+	sample.values[METRIC_CATCH_UP] = static_cast<float>(catchUpIterations);
+	written.store(frame + 1, std::memory_order_release);
+
+	for (unsigned int i = 0; i < METRIC_COUNT; ++i)
+	{
+		sessionMax[i] = std::max(sessionMax[i], sample.values[i]);
+	}
+	unsigned int bucket = static_cast<unsigned int>(frameTime.count() / SESSION_BUCKET_MS);
+	++sessionHistogram[std::min(bucket, SESSION_BUCKETS)];
+}
+
+unsigned int Telemetry::copySamples(FrameSample* samples) const
+{
+	uint64_t end = written.load(std::memory_order_acquire);
+	uint64_t begin = end > TELEMETRY_FRAMES ? end - TELEMETRY_FRAMES : 0;
+	for (uint64_t frame = begin; frame < end; ++frame)
+	{
+		samples[frame - begin] = ring[frame & (TELEMETRY_FRAMES - 1)];
+	}
+
+	// Drop the oldest samples if the writer lapped them while they were being copied
+	uint64_t now = written.load(std::memory_order_acquire);
+	uint64_t firstValid = now > TELEMETRY_FRAMES - 1 ? now - (TELEMETRY_FRAMES - 1) : 0;
+	if (firstValid > begin)
+	{
+		unsigned int skipped = static_cast<unsigned int>(std::min(firstValid, end) - begin);
+		memmove(samples, samples + skipped, (end - begin - skipped) * sizeof(FrameSample));
+		begin += skipped;
+	}
+	return static_cast<unsigned int>(end - begin);
+}
+
+void Telemetry::summarize(MetricSummary summaries[METRIC_COUNT], float histogram[FRAME_TIME_BUCKETS]) const
+{
+	FrameSample* samples = scratchSamples;
+	float* values = scratchValues;
+	unsigned int count = copySamples(samples);
+
+	memset(histogram, 0, FRAME_TIME_BUCKETS * sizeof(float));
+	for (unsigned int metric = 0; metric < METRIC_COUNT; ++metric)
+	{
+		MetricSummary& summary = summaries[metric];
+		summary = MetricSummary();
+		if (count == 0)
+		{
+			continue;
+		}
+
+		double total = 0.0;
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			values[i] = samples[i].values[metric];
+			total += values[i];
+		}
+		summary.mean = static_cast<float>(total / count);
+
+		// nth_element keeps everything past p50 above it, so p99 only searches that half
+		unsigned int median = count / 2;
+		unsigned int tail = std::min(count - 1, count * 99 / 100);
+		float* first = values;
+		std::nth_element(first, first + median, first + count);
+		summary.p50 = first[median];
+		std::nth_element(first + median, first + tail, first + count);
+		summary.p99 = first[tail];
+		summary.max = *std::max_element(first + tail, first + count);
+	}
+
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		unsigned int bucket = static_cast<unsigned int>(samples[i].values[METRIC_FRAME_MS] / FRAME_TIME_BUCKET_MS);
+		histogram[std::min(bucket, FRAME_TIME_BUCKETS - 1)] += 1.0f;
+	}
+}
+
+bool Telemetry::write(const char* fileName) const
+{
+	size_t length = strlen(fileName);
+	if (length >= 4 && strcmp(fileName + length - 4, ".csv") == 0)
+	{
+		return writeCSV(fileName);
+	}
+	return writeJSON(fileName);
+}
+
+bool Telemetry::writeCSV(const char* fileName) const
+{
+	FILE* file = fopen(fileName, "w");
+	if (!file)
+	{
+		std::cerr << "Error: Failed to open telemetry file: " << fileName << std::endl;
+		return false;
+	}
+
+	std::vector<FrameSample> samples(TELEMETRY_FRAMES);
+	unsigned int count = copySamples(samples.data());
+
+	fprintf(file, "frame");
+	for (unsigned int metric = 0; metric < METRIC_COUNT; ++metric)
+	{
+		fprintf(file, ",%s", telemetryMetricName(static_cast<TelemetryMetric>(metric)));
+	}
+	fprintf(file, "\n");
+
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		fprintf(file, "%llu", static_cast<unsigned long long>(samples[i].frame));
+		for (unsigned int metric = 0; metric < METRIC_COUNT; ++metric)
+		{
+			fprintf(file, ",%.4f", samples[i].values[metric]);
+		}
+		fprintf(file, "\n");
+	}
+
+	bool ok = !ferror(file);
+	fclose(file);
+
+	// A CSV file has one table, the summaries and the histogram get their own files
+	std::string base(fileName, strlen(fileName) - 4);
+	std::string summaryName = base + ".summary.csv";
+	std::string histogramName = base + ".histogram.csv";
+
+	MetricSummary summaries[METRIC_COUNT];
+	float histogram[FRAME_TIME_BUCKETS];
+	summarize(summaries, histogram);
+
+	file = fopen(summaryName.c_str(), "w");
+	if (!file)
+	{
+		std::cerr << "Error: Failed to open telemetry file: " << summaryName << std::endl;
+		return false;
+	}
+	fprintf(file, "metric,p50,p99,max,mean,session_max\n");
+	for (unsigned int metric = 0; metric < METRIC_COUNT; ++metric)
+	{
+		const MetricSummary& summary = summaries[metric];
+		fprintf(file, "%s,%.4f,%.4f,%.4f,%.4f,%.4f\n", telemetryMetricName(static_cast<TelemetryMetric>(metric)),
+			summary.p50, summary.p99, summary.max, summary.mean, sessionMax[metric]);
+	}
+	ok = !ferror(file) && ok;
+	fclose(file);
+
+	file = fopen(histogramName.c_str(), "w");
+	if (!file)
+	{
+		std::cerr << "Error: Failed to open telemetry file: " << histogramName << std::endl;
+		return false;
+	}
+	// Whole session; the last bucket counts every longer frame
+	fprintf(file, "frame_ms_from,frame_ms_to,frames\n");
+	for (unsigned int i = 0; i <= SESSION_BUCKETS; ++i)
+	{
+		if (i < SESSION_BUCKETS)
+			fprintf(file, "%.2f,%.2f,", i * SESSION_BUCKET_MS, (i + 1) * SESSION_BUCKET_MS);
+		else
+			fprintf(file, "%.2f,,", i * SESSION_BUCKET_MS);
+		fprintf(file, "%llu\n", static_cast<unsigned long long>(sessionHistogram[i]));
+	}
+	ok = !ferror(file) && ok;
+	fclose(file);
+
+	std::cout << "Wrote telemetry for " << count << " frames to " << fileName << ", " << summaryName << " and " << histogramName << std::endl;
+	return ok;
+}
+
+bool Telemetry::writeJSON(const char* fileName) const
+{
+	FILE* file = fopen(fileName, "w");
+	if (!file)
+	{
+		std::cerr << "Error: Failed to open telemetry file: " << fileName << std::endl;
+		return false;
+	}
+
+	std::vector<FrameSample> samples(TELEMETRY_FRAMES);
+	unsigned int count = copySamples(samples.data());
+
+	MetricSummary summaries[METRIC_COUNT];
+	float histogram[FRAME_TIME_BUCKETS];
+	summarize(summaries, histogram);
+
+	fprintf(file, "{\n  \"frames\": %llu,\n", static_cast<unsigned long long>(frameCount()));
+
+	fprintf(file, "  \"summary\": {\n");
+	for (unsigned int metric = 0; metric < METRIC_COUNT; ++metric)
+	{
+		const MetricSummary& summary = summaries[metric];
+		fprintf(file, "    \"%s\": { \"p50\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f, \"session_max\": %.4f }%s\n",
+			telemetryMetricName(static_cast<TelemetryMetric>(metric)), summary.p50, summary.p99, summary.max, summary.mean,
+			sessionMax[metric], metric + 1 < METRIC_COUNT ? "," : "");
+	}
+	fprintf(file, "  },\n");
+
+	fprintf(file, "  \"session_frame_ms_histogram\": { \"bucket_ms\": %.2f, \"counts\": [", SESSION_BUCKET_MS);
+	for (unsigned int i = 0; i <= SESSION_BUCKETS; ++i)
+	{
+		fprintf(file, "%s%llu", i ? ", " : "", static_cast<unsigned long long>(sessionHistogram[i]));
+	}
+	fprintf(file, "] },\n");
+
+	fprintf(file, "  \"samples\": [\n");
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		fprintf(file, "    { \"frame\": %llu", static_cast<unsigned long long>(samples[i].frame));
+		for (unsigned int metric = 0; metric < METRIC_COUNT; ++metric)
+		{
+			fprintf(file, ", \"%s\": %.4f", telemetryMetricName(static_cast<TelemetryMetric>(metric)), samples[i].values[metric]);
+		}
+		fprintf(file, " }%s\n", i + 1 < count ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+
+	bool ok = !ferror(file);
+	fclose(file);
+	std::cout << "Wrote telemetry for " << count << " frames to " << fileName << std::endl;
+	return ok;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Parts of a host frame, timed in the order the main loop runs them
+enum TelemetryPhase : uint8_t
+{
+	PHASE_EMULATION = 0, // Input, instructions, run-ahead and shared-state publishing
+	PHASE_UPLOAD,        // Display flip, texture upload and draw
+	PHASE_IMGUI,         // Building and rendering the debugger
+	PHASE_SWAP,          // Buffer swap, includes waiting for vsync
+	PHASE_COUNT
+};
+
+// Everything shown and exported, in column order
+enum TelemetryMetric : uint8_t
+{
+	METRIC_FRAME_MS = 0,
+	METRIC_EMULATION_MS,
+	METRIC_UPLOAD_MS,
+	METRIC_IMGUI_MS,
+	METRIC_SWAP_MS,
+	METRIC_INSTRUCTIONS,
+	METRIC_CATCH_UP,
+	METRIC_COUNT
+};
+
+struct FrameSample
+{
+	uint64_t frame;
+	float values[METRIC_COUNT];
+};
+
+struct MetricSummary
+{
+	float p50;
+	float p99;
+	float max;
+	float mean;
+};
+
+const unsigned int TELEMETRY_FRAMES = 8192;        // Frames kept for percentiles and export, a power of two
+const unsigned int FRAME_TIME_BUCKETS = 40;        // Frame time histogram shown in the debugger
+const float FRAME_TIME_BUCKET_MS = 1.0f;
+const unsigned int SESSION_BUCKETS = 400;          // Whole-session frame time histogram in the export
+const float SESSION_BUCKET_MS = 0.25f;
+
+const char* telemetryMetricName(TelemetryMetric metric);
+
+// Per-frame timings recorded by the main loop into a fixed ring of the last
+// TELEMETRY_FRAMES frames. The loop is the only writer and publishes each
+// sample with a release store of the frame count, so readers on other
+// threads never block it. Session-long maxima and a frame time histogram
+// cover stutter that has already left the ring.
+class Telemetry
+{
+public:
+	Telemetry();
+
+	void beginFrame();
+	// Charges the time since the previous mark to phase
+	void endPhase(TelemetryPhase phase);
+	void endFrame(uint32_t instructions, uint32_t catchUpIterations);
+
+	// Percentiles over the frames currently in the ring. Sorts a copy in scratch buffers owned by
+	// the object, so call it sparingly and from one thread at a time.
+	void summarize(MetricSummary summaries[METRIC_COUNT], float histogram[FRAME_TIME_BUCKETS]) const;
+
+	// Writes the ring, the summaries and the session histogram. JSON puts everything in one file;
+	// for a name ending in .csv the ring goes to fileName and the summaries and histogram to
+	// sibling files with .summary.csv and .histogram.csv in place of .csv.
+	bool write(const char* fileName) const;
+	uint64_t frameCount() const { return written.load(std::memory_order_acquire); }
+public:
+	float sessionMax[METRIC_COUNT]{};
+	uint64_t sessionHistogram[SESSION_BUCKETS + 1]{};  // Last bucket counts everything longer
+private:
+	unsigned int copySamples(FrameSample* samples) const;
+	bool writeJSON(const char* fileName) const;
+	bool writeCSV(const char* fileName) const;
+private:
+	FrameSample ring[TELEMETRY_FRAMES];
+	std::atomic<uint64_t> written;
+
+	std::chrono::high_resolution_clock::time_point frameStart;
+	std::chrono::high_resolution_clock::time_point lastMark;
+	float phaseMs[PHASE_COUNT]{};
+
+	// summarize() works on these so refreshing the debugger does not allocate
+	mutable FrameSample scratchSamples[TELEMETRY_FRAMES];
+	mutable float scratchValues[TELEMETRY_FRAMES];
+};
@@ -0,0 +1,49 @@
+#include "Timing.h"
+
+const unsigned int VIP_FETCH_CYCLES = 40;
+
+unsigned int vipInstructionCycles(uint16_t opcode, bool skipped)
+{
+	unsigned int X = (opcode >> 8u) & 0x0Fu;
+	unsigned int N = opcode & 0x000Fu;
+	unsigned int skipCycles = skipped ? 4 : 0;
+	unsigned int cycles = 0;
+
+	switch (opcode & 0xF000u)
+	{
+	case 0x0000u:
+		if (opcode == 0x00E0u)
+			cycles = 3078; // Clears all 256 bytes of display memory
+		else if (opcode == 0x00EEu)
+			cycles = 10;
+		break;
+	case 0x1000u: cycles = 12; break;
+	case 0x2000u: cycles = 26; break;
+	case 0x3000u:
+	case 0x4000u: cycles = 10 + skipCycles; break;
+	case 0x5000u:
+	case 0x9000u: cycles = 14 + skipCycles; break;
+	case 0x6000u: cycles = 6; break;
+	case 0x7000u: cycles = 10; break;
+	case 0x8000u: cycles = 44; break;
+	case 0xA000u: cycles = 12; break;
+	case 0xB000u: cycles = 22; break;
+	case 0xC000u: cycles = 36; break;
+	case 0xD000u: cycles = 26 + 46 * N; break;
+	case 0xE000u: cycles = 14 + skipCycles; break;
+	case 0xF000u:
+		switch (opcode & 0x00FFu)
+		{
+		case 0x0Au: cycles = 20; break;
+		case 0x1Eu:
+		case 0x29u: cycles = 16; break;
+		case 0x33u: cycles = 84; break;
+		case 0x55u:
+		case 0x65u: cycles = 14 + 14 * (X + 1); break;
+		default: cycles = 10; break;
+		}
+		break;
+	}
+
+	return VIP_FETCH_CYCLES + cycles;
+}
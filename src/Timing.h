@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+// Machine cycles the COSMAC VIP interpreter gets per 60 Hz frame: ~3668 cycles at 1.76 MHz,
+// minus what the 1861 display DMA and the interrupt routine take
+const int VIP_CYCLES_PER_FRAME = 2600;
+
+// Approximate machine cycles the original COSMAC VIP interpreter spends on an instruction,
+// including fetch and decode. `skipped` tells whether a conditional skip was taken.
+unsigned int vipInstructionCycles(uint16_t opcode, bool skipped);
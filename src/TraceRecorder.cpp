@@ -0,0 +1,80 @@
+#include "TraceRecorder.h"
+
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+TraceRecorder::~TraceRecorder()
+{
+	close();
+}
+
+bool TraceRecorder::open(const char* fileName, uint32_t capacity)
+{
+	close();
+
+	if (capacity == 0 || capacity > TRACE_MAX_CAPACITY)
+	{
+		std::cerr << "Error: Trace capacity must be between 1 and " << TRACE_MAX_CAPACITY << " records" << std::endl;
+		return false;
+	}
+
+	// Round up to a power of two so the ring index is a mask
+	uint32_t ringSize = 1;
+	while (ringSize < capacity)
+	{
+		ringSize <<= 1;
+	}
+
+	int fd = ::open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		std::cerr << "Error: Failed to open trace file: " << fileName << std::endl;
+		return false;
+	}
+
+	size_t size = sizeof(TraceHeader) + static_cast<size_t>(ringSize) * sizeof(TraceRecord);
+	if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+	{
+		std::cerr << "Error: Failed to size trace file: " << fileName << std::endl;
+		::close(fd);
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		std::cerr << "Error: Failed to map trace file: " << fileName << std::endl;
+		return false;
+	}
+
+	mappedSize = size;
+	mask = ringSize - 1;
+	header = static_cast<TraceHeader*>(mapping);
+	records = reinterpret_cast<TraceRecord*>(header + 1);
+
+	header->magic = TRACE_MAGIC;
+	header->version = TRACE_VERSION;
+	header->recordSize = sizeof(TraceRecord);
+	header->capacity = ringSize;
+	header->count = 0;
+	header->reserved = 0;
+
+	std::cout << "Tracing to " << fileName << " (" << ringSize << " records)" << std::endl;
+	return true;
+}
+
+void TraceRecorder::close()
+{
+	if (!header)
+	{
+		return;
+	}
+
+	munmap(header, mappedSize);
+	header = nullptr;
+	records = nullptr;
+	mappedSize = 0;
+}
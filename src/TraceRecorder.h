@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+const uint32_t TRACE_MAGIC = 0x52543843; // "C8TR"
+const uint32_t TRACE_VERSION = 2;
+const uint32_t TRACE_MAX_CAPACITY = 1u << 31;
+
+// One executed instruction and the machine state right after it
+struct TraceRecord
+{
+	uint64_t cycle;          // Chip8::cycleCount, wide enough that it never wraps
+	uint16_t pc;             // Address the instruction was fetched from
+	uint16_t opcode;
+	uint16_t indexRegister;
+	uint16_t memoryAddress;  // First byte written by OP_FX33/OP_FX55
+	uint8_t memoryLength;    // Number of bytes written to memory, 0 if none
+	uint8_t sp;
+	uint8_t delayTimer;
+	uint8_t soundTimer;
+	uint8_t registers[16];
+	uint8_t reserved[4];
+};
+
+struct TraceHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t recordSize;
+	uint32_t capacity;       // Number of records in the ring, a power of two
+	uint64_t count;          // Total records written, the ring holds the last `capacity` of them
+	uint64_t reserved;
+};
+
+static_assert(sizeof(TraceRecord) == 40, "Trace records must stay fixed-size");
+static_assert(sizeof(TraceHeader) == 32, "Trace header must stay fixed-size");
+
+// Appends a TraceRecord per executed instruction to a ring buffer in a
+// memory-mapped file, so the trace survives a crash and costs a handful of
+// stores per instruction.
+class TraceRecorder
+{
+public:
+	~TraceRecorder();
+
+	bool open(const char* fileName, uint32_t capacity);
+	void close();
+	bool isOpen() const { return header != nullptr; }
+
+	void record(uint64_t cycle, uint16_t pc, uint16_t opcode, uint16_t indexRegister,
+		uint8_t sp, uint8_t delayTimer, uint8_t soundTimer, const uint8_t* registers)
+	{
+		TraceRecord& entry = records[header->count & mask];
+		entry.cycle = cycle;
+		entry.pc = pc;
+		entry.opcode = opcode;
+		entry.indexRegister = indexRegister;
+		entry.sp = sp;
+		entry.delayTimer = delayTimer;
+		entry.soundTimer = soundTimer;
+		memcpy(entry.registers, registers, sizeof(entry.registers));
+
+		// Only OP_FX33 and OP_FX55 write to memory
+		entry.memoryAddress = indexRegister;
+		if ((opcode & 0xF0FFu) == 0xF033u)
+			entry.memoryLength = 3;
+		else if ((opcode & 0xF0FFu) == 0xF055u)
+			entry.memoryLength = ((opcode >> 8u) & 0x0Fu) + 1;
+		else
+			entry.memoryLength = 0;
+
+		++header->count;
+	}
+private:
+	TraceHeader* header{};
+	TraceRecord* records{};
+	uint64_t mask{};
+	size_t mappedSize{};
+};
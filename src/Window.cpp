@@ -1,4 +1,12 @@
 #include "Window.h"
+#include "Disassembler.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+const unsigned int MEMORY_VIEW_COLUMNS = 16;
+const float MEMORY_HEAT_HALF_LIFE = 0.5f; // Seconds for a write's highlight to fade to half
 
 const char* vertexShaderSource = R"glsl(
     #version 330 core
@@ -72,6 +80,7 @@ Window::Window(int width, int height, const std::string& title, Chip8* chip8Emul
 	glfwSetWindowUserPointer(m_Window, this);
 	glfwSetFramebufferSizeCallback(m_Window, framebufferSizeCallback);
 	glfwSetKeyCallback(m_Window, keyCallback);
+	glfwSetDropCallback(m_Window, dropCallback);
 }
 
 Window::~Window()
@@ -87,12 +96,36 @@ Window::~Window()
 	glfwTerminate();
 }
 
-void Window::update()
+void Window::pollEvents()
 {
 	glfwPollEvents();
+}
+
+void Window::update()
+{
 	glfwSwapBuffers(m_Window);
 }
 
+bool Window::takeROMRequest(std::string& fileName)
+{
+	if (!romRequested)
+	{
+		return false;
+	}
+
+	fileName = requestedROM;
+	romRequested = false;
+	return true;
+}
+
+void Window::setROMStatus(const std::string& fileName, float swapMicroseconds)
+{
+	strncpy(romPathInput, fileName.c_str(), sizeof(romPathInput) - 1);
+	romPathInput[sizeof(romPathInput) - 1] = '\0';
+	currentROM = fileName;
+	lastSwapMicroseconds = swapMicroseconds;
+}
+
 void Window::clear() const
 {
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -212,7 +245,7 @@ void Window::initializeImGui() const
 	ImGui::GetIO().ConfigFlags |= ImGuiConfigFlags_DockingEnable;
 }
 
-void Window::renderImGui() const
+void Window::renderImGui()
 {
 	ImGui_ImplOpenGL3_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
@@ -236,9 +269,63 @@ void Window::renderImGui() const
 
 	ImGui::Text("Frame Time: %.2f ms", 1000.0f / ImGui::GetIO().Framerate);
 	ImGui::Text("Delta Time: %.6f ms", ImGui::GetIO().DeltaTime * 1000.0f);
+	renderTelemetry();
 
+	renderROMControls();
+
+	ImGui::Text("Timing: %s", myChip8->timingMode == TIMING_COSMAC_VIP ? "COSMAC VIP" : "Fixed rate");
+	if (myRunAhead)
+	{
+		ImGui::Text("Run-Ahead: %d frames, %.3f ms (avg %.3f ms)", myRunAhead->frames, myRunAhead->lastCostMs, myRunAhead->averageCostMs);
+	}
+	if (myNetplay)
+	{
+		ImGui::Text("Netplay: frame %u, confirmed %u", myNetplay->frame, myNetplay->confirmedFrame);
+		ImGui::Text("Rollbacks: %llu (max %u frames), %.3f ms (max %.3f ms)", static_cast<unsigned long long>(myNetplay->rollbacks),
+			myNetplay->maxRollbackFrames, myNetplay->lastRollbackMs, myNetplay->maxRollbackMs);
+		ImGui::Text("Stalls: %llu", static_cast<unsigned long long>(myNetplay->stalls));
+		if (myNetplay->desyncs)
+		{
+			ImGui::SameLine();
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Desyncs: %llu", static_cast<unsigned long long>(myNetplay->desyncs));
+		}
+	}
 	ImGui::Text("Current Opcode: 0x%04X", myChip8->opcode);
 
+	if (myChip8->runState == RUN_HALTED)
+	{
+		ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Halted");
+	}
+	else if (myChip8->runState == RUN_TRAPPED)
+	{
+		ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.2f, 1.0f), "Trapped at PC 0x%03X", myChip8->pc);
+		ImGui::SameLine();
+		if (ImGui::Button("Resume"))
+		{
+			myChip8->runState = RUN_RUNNING;
+		}
+	}
+
+	if (myDiagnostics)
+	{
+		for (unsigned int i = 0; i < DIAG_KIND_COUNT; ++i)
+		{
+			uint64_t count = myDiagnostics->counts[i].load(std::memory_order_relaxed);
+			if (count)
+			{
+				ImGui::Text("%s: %llu", diagnosticName(static_cast<DiagnosticKind>(i)), static_cast<unsigned long long>(count));
+			}
+		}
+	}
+
+	if (myInputQueue)
+	{
+		ImGui::Text("Input Latency: %.2f ms (max %.2f ms)", myInputQueue->lastLatencyMs, myInputQueue->maxLatencyMs);
+		ImGui::PlotHistogram("##InputLatency", myInputQueue->latencyHistogram, LATENCY_BUCKETS, 0,
+			"0-50 ms", 0.0f, 3.4e38f, ImVec2(0.0f, 40.0f));
+		ImGui::Text("Last Input Applied At Cycle: %llu", static_cast<unsigned long long>(myInputQueue->lastAppliedCycle));
+	}
+
 	ImGui::Text("Registers:");
 	for (int i = 0; i < 16; ++i) {
 		ImGui::Text("V%X: 0x%02X", i, myChip8->registers[i]);
@@ -255,10 +342,233 @@ void Window::renderImGui() const
 
 	ImGui::End();
 
+	renderDisassembly();
+	renderMemory();
+
 	ImGui::Render();
 	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
+void Window::renderROMControls()
+{
+	// Enter in the path field loads it, as does dropping a file on the window
+	bool load = ImGui::InputText("ROM", romPathInput, sizeof(romPathInput), ImGuiInputTextFlags_EnterReturnsTrue);
+	load = ImGui::Button("Load") || load;
+	if (load)
+	{
+		requestedROM = romPathInput;
+		romRequested = !requestedROM.empty();
+	}
+	ImGui::SameLine();
+	// Loading resets the machine, so restarting is reloading the running ROM, whatever the path field says
+	if (ImGui::Button("Restart"))
+	{
+		requestedROM = currentROM;
+		romRequested = !requestedROM.empty();
+	}
+	ImGui::SameLine();
+	ImGui::Checkbox("Watch File", &watchROM);
+	ImGui::Text("Last ROM Switch: %.1f us", lastSwapMicroseconds);
+	ImGui::Separator();
+}
+
+void Window::renderTelemetry()
+{
+	if (!myTelemetry)
+	{
+		return;
+	}
+
+	// Percentiles sort the whole ring, twice a second is plenty
+	uint64_t frames = myTelemetry->frameCount();
+	if (frames - telemetrySummaryFrame >= 30 || frames < telemetrySummaryFrame)
+	{
+		myTelemetry->summarize(telemetrySummaries, frameTimeHistogram);
+		telemetrySummaryFrame = frames;
+	}
+
+	if (!ImGui::CollapsingHeader("Telemetry"))
+	{
+		return;
+	}
+
+	ImGui::Text("%-20s %8s %8s %8s", "", "p50", "p99", "max");
+	for (unsigned int i = 0; i < METRIC_COUNT; ++i)
+	{
+		const MetricSummary& summary = telemetrySummaries[i];
+		ImGui::Text("%-20s %8.2f %8.2f %8.2f", telemetryMetricName(static_cast<TelemetryMetric>(i)), summary.p50, summary.p99, summary.max);
+	}
+	ImGui::PlotHistogram("##FrameTime", frameTimeHistogram, FRAME_TIME_BUCKETS, 0,
+		"Frame time 0-40 ms", 0.0f, 3.4e38f, ImVec2(0.0f, 40.0f));
+}
+
+void Window::renderDisassembly()
+{
+	if (!myAnalyzer)
+	{
+		return;
+	}
+
+	ImGui::SetNextWindowSize(ImVec2(300.0f, 400.0f), ImGuiCond_FirstUseEver);
+	ImGui::Begin("Disassembly", nullptr, ImGuiWindowFlags_NoCollapse);
+
+	ImGui::Checkbox("Follow PC", &followPC);
+	ImGui::SameLine();
+	ImGui::Text("Blocks: %u  Subroutines: %u", static_cast<unsigned int>(myAnalyzer->blocks.size()), static_cast<unsigned int>(myAnalyzer->subroutines.size()));
+
+	ImGui::BeginChild("DisassemblyListing");
+
+	const std::vector<uint16_t>& listing = myAnalyzer->listing;
+	float lineHeight = ImGui::GetTextLineHeightWithSpacing();
+
+	if (followPC)
+	{
+		int pcLine = myAnalyzer->listingIndex[myChip8->pc & (MEMORY_SIZE - 1)];
+		if (pcLine >= 0)
+		{
+			ImGui::SetScrollY(pcLine * lineHeight - ImGui::GetWindowHeight() * 0.5f);
+		}
+	}
+
+	// Only the visible lines are formatted
+	ImGuiListClipper clipper;
+	clipper.Begin(static_cast<int>(listing.size()), lineHeight);
+	while (clipper.Step())
+	{
+		for (int line = clipper.DisplayStart; line < clipper.DisplayEnd; ++line)
+		{
+			uint16_t address = listing[line];
+			const char* marker = (address == myChip8->pc) ? ">" : " ";
+
+			if (myAnalyzer->byteType[address] == BYTE_CODE_START)
+			{
+				uint16_t opcode = myChip8->memory[address] << 8u | myChip8->memory[address + 1];
+				const char* label = (myAnalyzer->blockAt(address) >= 0) ? ":" : " ";
+				ImGui::Text("%s%03X%s %04X  %s", marker, address, label, opcode, disassembleOpcode(opcode).c_str());
+			}
+			else
+			{
+				ImGui::TextDisabled("%s%03X  %02X    data", marker, address, myChip8->memory[address]);
+			}
+		}
+	}
+
+	ImGui::EndChild();
+	ImGui::End();
+}
+
+void Window::formatMemoryRow(unsigned int row)
+{
+	const uint8_t* bytes = &myChip8->memory[row * MEMORY_VIEW_COLUMNS];
+	char* text = memoryRowText[row];
+
+	// "200  00 E0 A2 2A ...  ..*." with the byte columns at 5 + 3 * column, where the heat overlay expects them
+	int length = snprintf(text, sizeof(memoryRowText[row]), "%03X ", row * MEMORY_VIEW_COLUMNS);
+	for (unsigned int column = 0; column < MEMORY_VIEW_COLUMNS; ++column)
+	{
+		length += snprintf(text + length, sizeof(memoryRowText[row]) - length, " %02X", bytes[column]);
+	}
+	text[length++] = ' ';
+	text[length++] = ' ';
+	for (unsigned int column = 0; column < MEMORY_VIEW_COLUMNS; ++column)
+	{
+		text[length++] = (bytes[column] >= 0x20 && bytes[column] < 0x7F) ? static_cast<char>(bytes[column]) : '.';
+	}
+	text[length] = '\0';
+}
+
+void Window::renderMemory()
+{
+	const unsigned int rowCount = MEMORY_SIZE / MEMORY_VIEW_COLUMNS;
+	const unsigned int rowsPerWord = 64 / MEMORY_VIEW_COLUMNS;
+	const unsigned int wordCount = MEMORY_SIZE / 64;
+
+	float decay = std::pow(0.5f, ImGui::GetIO().DeltaTime / MEMORY_HEAT_HALF_LIFE);
+	for (float& heat : memoryHeat)
+	{
+		heat *= decay;
+	}
+
+	// Every bit set means a reset or ROM load: reformat everything but do not light up all of memory
+	bool reloaded = true;
+	for (unsigned int word = 0; word < wordCount; ++word)
+	{
+		reloaded = reloaded && myChip8->memoryWrites[word] == ~0ull;
+	}
+
+	for (unsigned int word = 0; word < wordCount; ++word)
+	{
+		// Changed bytes only need their row reformatted, written ones also light up
+		uint64_t bits = myChip8->memoryWrites[word];
+		uint64_t changed = bits | myChip8->memoryChanged[word];
+		if (!changed)
+		{
+			continue;
+		}
+		myChip8->memoryWrites[word] = 0;
+		myChip8->memoryChanged[word] = 0;
+
+		for (unsigned int part = 0; part < rowsPerWord; ++part)
+		{
+			unsigned int rowBits = (bits >> (part * MEMORY_VIEW_COLUMNS)) & 0xFFFFu;
+			if (!((changed >> (part * MEMORY_VIEW_COLUMNS)) & 0xFFFFu))
+			{
+				continue;
+			}
+
+			unsigned int row = word * rowsPerWord + part;
+			formatMemoryRow(row);
+			for (unsigned int column = 0; column < MEMORY_VIEW_COLUMNS && !reloaded; ++column)
+			{
+				if (rowBits & (1u << column))
+				{
+					memoryHeat[row * MEMORY_VIEW_COLUMNS + column] = 1.0f;
+				}
+			}
+		}
+	}
+
+	ImGui::SetNextWindowSize(ImVec2(480.0f, 400.0f), ImGuiCond_FirstUseEver);
+	ImGui::Begin("Memory", nullptr, ImGuiWindowFlags_NoCollapse);
+	ImGui::TextDisabled("Written bytes light up and fade, red marks writes to analyzed code");
+	ImGui::BeginChild("MemoryRows");
+
+	float charWidth = ImGui::CalcTextSize("0").x;
+	float textHeight = ImGui::GetTextLineHeight();
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+
+	ImGuiListClipper clipper;
+	clipper.Begin(static_cast<int>(rowCount), ImGui::GetTextLineHeightWithSpacing());
+	while (clipper.Step())
+	{
+		for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+		{
+			ImVec2 origin = ImGui::GetCursorScreenPos();
+			for (unsigned int column = 0; column < MEMORY_VIEW_COLUMNS; ++column)
+			{
+				unsigned int address = row * MEMORY_VIEW_COLUMNS + column;
+				float heat = memoryHeat[address];
+				if (heat < 0.02f)
+				{
+					continue;
+				}
+
+				// Writes into code are self-modification and stand out in red, data writes are amber
+				bool isCode = myAnalyzer && (myAnalyzer->byteType[address] == BYTE_CODE_START || myAnalyzer->byteType[address] == BYTE_CODE);
+				ImU32 alpha = static_cast<ImU32>(heat * 160.0f);
+				ImU32 color = isCode ? IM_COL32(230, 40, 40, alpha) : IM_COL32(230, 160, 30, alpha);
+
+				float x = origin.x + charWidth * (5 + 3 * column);
+				drawList->AddRectFilled(ImVec2(x, origin.y), ImVec2(x + 2.0f * charWidth, origin.y + textHeight), color);
+			}
+			ImGui::TextUnformatted(memoryRowText[row]);
+		}
+	}
+
+	ImGui::EndChild();
+	ImGui::End();
+}
+
 void Window::shutdownImGui() const
 {
 	ImGui_ImplOpenGL3_Shutdown();
@@ -271,6 +581,17 @@ void Window::framebufferSizeCallback(GLFWwindow* window, int width, int height)
 	glViewport(0, 0, width - 300.0f, height);
 }
 
+void Window::dropCallback(GLFWwindow* window, int count, const char** paths)
+{
+	Window* winInstance = static_cast<Window*>(glfwGetWindowUserPointer(window));
+	if (!winInstance || count < 1)
+		return;
+
+	// Only one ROM can run, the first dropped file wins
+	winInstance->requestedROM = paths[0];
+	winInstance->romRequested = true;
+}
+
 void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
 	Window* winInstance = static_cast<Window*>(glfwGetWindowUserPointer(window));
@@ -282,30 +603,40 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
 	if (action == GLFW_PRESS || action == GLFW_RELEASE)
 	{
 		bool isPressed = (action == GLFW_PRESS);
+		int chip8Key = -1;
 
 		switch (key)
 		{
-		case GLFW_KEY_3: winInstance->myChip8->keypad[1] = isPressed; break;
-		case GLFW_KEY_4: winInstance->myChip8->keypad[2] = isPressed; break;
-		case GLFW_KEY_5: winInstance->myChip8->keypad[3] = isPressed; break;
-		case GLFW_KEY_6: winInstance->myChip8->keypad[0xC] = isPressed; break;
-
-		case GLFW_KEY_E: winInstance->myChip8->keypad[4] = isPressed; break;
-		case GLFW_KEY_R: winInstance->myChip8->keypad[5] = isPressed; break;
-		case GLFW_KEY_T: winInstance->myChip8->keypad[6] = isPressed; break;
-		case GLFW_KEY_Y: winInstance->myChip8->keypad[0xD] = isPressed; break;
-
-		case GLFW_KEY_D: winInstance->myChip8->keypad[7] = isPressed; break;
-		case GLFW_KEY_F: winInstance->myChip8->keypad[8] = isPressed; break;
-		case GLFW_KEY_G: winInstance->myChip8->keypad[9] = isPressed; break;
-		case GLFW_KEY_H: winInstance->myChip8->keypad[0xE] = isPressed; break;
-
-		case GLFW_KEY_C: winInstance->myChip8->keypad[0xA] = isPressed; break;
-		case GLFW_KEY_V: winInstance->myChip8->keypad[0] = isPressed; break;
-		case GLFW_KEY_B: winInstance->myChip8->keypad[0xB] = isPressed; break;
-		case GLFW_KEY_N: winInstance->myChip8->keypad[0xF] = isPressed; break;
+		case GLFW_KEY_3: chip8Key = 1; break;
+		case GLFW_KEY_4: chip8Key = 2; break;
+		case GLFW_KEY_5: chip8Key = 3; break;
+		case GLFW_KEY_6: chip8Key = 0xC; break;
+
+		case GLFW_KEY_E: chip8Key = 4; break;
+		case GLFW_KEY_R: chip8Key = 5; break;
+		case GLFW_KEY_T: chip8Key = 6; break;
+		case GLFW_KEY_Y: chip8Key = 0xD; break;
+
+		case GLFW_KEY_D: chip8Key = 7; break;
+		case GLFW_KEY_F: chip8Key = 8; break;
+		case GLFW_KEY_G: chip8Key = 9; break;
+		case GLFW_KEY_H: chip8Key = 0xE; break;
+
+		case GLFW_KEY_C: chip8Key = 0xA; break;
+		case GLFW_KEY_V: chip8Key = 0; break;
+		case GLFW_KEY_B: chip8Key = 0xB; break;
+		case GLFW_KEY_N: chip8Key = 0xF; break;
 
 		default: break;
 		}
+
+		if (chip8Key < 0)
+			return;
+
+		// Queued events are applied by the emulation loop between instructions
+		if (winInstance->myInputQueue)
+			winInstance->myInputQueue->push(static_cast<uint8_t>(chip8Key), isPressed);
+		else
+			winInstance->myChip8->keypad[chip8Key] = isPressed;
 	}
 }
\ No newline at end of file
@@ -10,31 +10,75 @@
 #include <imgui_internal.h>
 
 #include "Chip8.h"
+#include "Analyzer.h"
+#include "RunAhead.h"
+#include "InputQueue.h"
+#include "Diagnostics.h"
+#include "Telemetry.h"
+#include "Netplay.h"
 
 class Window {
 public:
 	Window(int width, int height, const std::string& title, Chip8* chip8Emulator);
 	~Window();
 
+	void pollEvents();
 	void update();
-	void renderImGui() const;
+	void renderImGui();
 	void clear() const;
 	bool shouldClose() const;
 	int getWidth() const;
 	int getHeight() const;
 	GLuint* getTexture() { return &textureID; }
 	GLuint* getVAO() { return &VAO; }
+	void setAnalyzer(const Analyzer* analyzer) { myAnalyzer = analyzer; }
+	void setRunAhead(const RunAhead* runAhead) { myRunAhead = runAhead; }
+	void setInputQueue(InputQueue* inputQueue) { myInputQueue = inputQueue; }
+	void setDiagnostics(const Diagnostics* diagnostics) { myDiagnostics = diagnostics; }
+	void setTelemetry(const Telemetry* telemetry) { myTelemetry = telemetry; }
+	void setNetplay(const RollbackSession* netplay) { myNetplay = netplay; }
+
+	// ROM switching: the panel and drag-and-drop only request a ROM, the emulation loop loads it
+	bool takeROMRequest(std::string& fileName);
+	void setROMStatus(const std::string& fileName, float swapMicroseconds);
+	bool isWatchingROM() const { return watchROM; }
+	void setWatchROM(bool watch) { watchROM = watch; }
 private:
 	void initializeImGui() const;
 	void shutdownImGui() const;
+	void renderDisassembly();
+	void renderROMControls();
+	void renderTelemetry();
+	void renderMemory();
+	void formatMemoryRow(unsigned int row);
 private:
 	GLFWwindow* m_Window;
 	Chip8* myChip8;
+	const Analyzer* myAnalyzer{};
+	const RunAhead* myRunAhead{};
+	InputQueue* myInputQueue{};
+	const Diagnostics* myDiagnostics{};
+	const Telemetry* myTelemetry{};
+	const RollbackSession* myNetplay{};
+	MetricSummary telemetrySummaries[METRIC_COUNT]{};
+	float frameTimeHistogram[FRAME_TIME_BUCKETS]{};
+	uint64_t telemetrySummaryFrame{};
+	// Memory viewer: 16 bytes per row, only rows the core reports as written are reformatted
+	char memoryRowText[MEMORY_SIZE / 16][80]{};
+	float memoryHeat[MEMORY_SIZE]{};
+	bool followPC{ true };
+	char romPathInput[512]{};
+	std::string currentROM;
+	std::string requestedROM;
+	bool romRequested{};
+	bool watchROM{};
+	float lastSwapMicroseconds{};
 	int m_Width, m_Height;
 	int vSynch;
 	
 	static void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+	static void dropCallback(GLFWwindow* window, int count, const char** paths);
 private:
 	GLuint VAO{}, VBO{}, textureID{};
 	GLuint shaderProgram{}, vertexShader{}, fragmentShader{};
@@ -0,0 +1,576 @@
+// Runs every ROM in a directory headlessly on every engine and checks its framebuffer against
+// golden hashes.
+//
+// Each ROM `name` needs a `name.expect` file next to it, one directive per line:
+//   # comment
+//   instructions-per-frame <N>   Instructions per 60 Hz frame in fixed timing (default 9)
+//   timing <fixed|vip>
+//   wrap-sprites
+//   press <Frame> <Key>          Key down at the start of Frame
+//   release <Frame> <Key>        Key up at the start of Frame
+//   frame <Frame> <Hash>         Expected framebufferHash() after Frame frames
+//   vip-frame <Frame> <Hash>     Same for the vip engine, which runs only if these are given
+//   min-mips <N>                 Fail if an engine runs slower than N million instructions per second
+//
+// Engines:
+//   interpreter   Chip8::runFrame(), checked against the `frame` hashes
+//   fused         Superinstructions installed, must match the interpreter at every checkpoint
+//   aot           The compiled module `name.so` next to the ROM if there is one, same check
+//   vip           The interpreter in TIMING_COSMAC_VIP, checked against the `vip-frame` hashes
+//
+// A few built-in cases run along with the directory, they carry their ROM and guard engine bugs
+// that were fixed before.
+//
+// When a golden hash does not match, the actual framebuffer is written to the output directory as
+// `name.frame<Frame>.actual.pbm` (`name.vip.frame<Frame>...` for the vip engine). If a golden
+// `name.frame<Frame>.pbm` sits next to the ROM, `name.frame<Frame>.diff.ppm` shows pixels only in
+// the golden image in red and pixels only in the actual one in green.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "Chip8.h"
+#include "Analyzer.h"
+#include "Fusion.h"
+#include "AotModule.h"
+
+enum Engine
+{
+	ENGINE_INTERPRETER = 0,
+	ENGINE_FUSED,
+	ENGINE_AOT,
+	ENGINE_VIP,
+	ENGINE_COUNT
+};
+
+static const char* const ENGINE_NAMES[ENGINE_COUNT] = { "interpreter", "fused", "aot", "vip" };
+
+struct InputStep
+{
+	unsigned int frame;
+	uint8_t key;
+	bool pressed;
+};
+
+struct Checkpoint
+{
+	unsigned int frame;
+	uint64_t hash;
+};
+
+struct ConformanceCase
+{
+	std::string name;
+	std::string romPath;
+	std::vector<uint8_t> romData;  // Built-in cases carry their ROM instead of a path
+	unsigned int instructionsPerFrame = 9;
+	TimingMode timingMode = TIMING_FIXED_RATE;
+	Chip8Quirks quirks;
+	std::vector<InputStep> inputs;
+	std::vector<Checkpoint> checkpoints;
+	std::vector<Checkpoint> vipCheckpoints;
+	double minMips = 0.0;
+};
+
+struct EngineRun
+{
+	bool ran = false;
+	uint64_t instructions = 0;
+	double seconds = 0.0;
+	// framebufferHash() and Chip8::stateHash() at each checkpoint
+	std::vector<uint64_t> framebufferHashes;
+	std::vector<uint64_t> stateHashes;
+};
+
+struct ConformanceResult
+{
+	bool passed = false;
+	std::string error;
+	std::vector<std::string> failures;
+	EngineRun engines[ENGINE_COUNT];
+};
+
+// 64-bit FNV-1a over the 1-bit framebuffer, row by row from the leftmost pixel
+static uint64_t framebufferHash(const Chip8& chip8)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (unsigned int y = 0; y < DISPLAY_HEIGHT; ++y)
+	{
+		for (int shift = 56; shift >= 0; shift -= 8)
+		{
+			hash ^= (chip8.displayRows[y] >> shift) & 0xFFu;
+			hash *= 0x100000001B3ull;
+		}
+	}
+	return hash;
+}
+
+static bool parseExpectations(const std::string& path, ConformanceCase& test, std::string& error)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		error = "cannot open " + path;
+		return false;
+	}
+
+	std::string line;
+	unsigned int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		++lineNumber;
+		std::istringstream words(line);
+		std::string directive;
+		if (!(words >> directive) || directive[0] == '#')
+		{
+			continue;
+		}
+
+		bool valid = true;
+		if (directive == "instructions-per-frame")
+		{
+			valid = static_cast<bool>(words >> test.instructionsPerFrame);
+		}
+		else if (directive == "timing")
+		{
+			std::string mode;
+			valid = (words >> mode) && (mode == "fixed" || mode == "vip");
+			test.timingMode = (mode == "vip") ? TIMING_COSMAC_VIP : TIMING_FIXED_RATE;
+		}
+		else if (directive == "wrap-sprites")
+		{
+			test.quirks.wrapSprites = true;
+		}
+		else if (directive == "press" || directive == "release")
+		{
+			InputStep step;
+			unsigned int key = 0;
+			valid = (words >> step.frame >> std::hex >> key) && key < 16;
+			step.key = static_cast<uint8_t>(key);
+			step.pressed = (directive == "press");
+			test.inputs.push_back(step);
+		}
+		else if (directive == "frame" || directive == "vip-frame")
+		{
+			Checkpoint checkpoint;
+			valid = static_cast<bool>(words >> checkpoint.frame >> std::hex >> checkpoint.hash);
+			(directive == "frame" ? test.checkpoints : test.vipCheckpoints).push_back(checkpoint);
+		}
+		else if (directive == "min-mips")
+		{
+			valid = static_cast<bool>(words >> test.minMips);
+		}
+		else
+		{
+			valid = false;
+		}
+
+		if (!valid)
+		{
+			error = path + ":" + std::to_string(lineNumber) + ": invalid line";
+			return false;
+		}
+	}
+
+	std::stable_sort(test.inputs.begin(), test.inputs.end(),
+		[](const InputStep& a, const InputStep& b) { return a.frame < b.frame; });
+	auto byFrame = [](const Checkpoint& a, const Checkpoint& b) { return a.frame < b.frame; };
+	std::sort(test.checkpoints.begin(), test.checkpoints.end(), byFrame);
+	std::sort(test.vipCheckpoints.begin(), test.vipCheckpoints.end(), byFrame);
+	return true;
+}
+
+static void addBuiltinCases(std::vector<ConformanceCase>& tests)
+{
+	// FX1E walks I past 0xFFF, then FX55 stores through the wrapped address over the 6XNN run
+	// fused at 0x200, turning 6106 into 7377. The fused engine must drop the superinstruction.
+	static const uint8_t wrappedStore[] = {
+		0x60, 0x05, 0x61, 0x06, 0x62, 0x07, 0x60, 0x73, 0x61, 0x77, 0xAF, 0xFF, 0x64, 0xFF,
+		0xF4, 0x1E, 0xF4, 0x1E, 0x64, 0x05, 0xF4, 0x1E, 0xF1, 0x55, 0x12, 0x00
+	};
+
+	ConformanceCase test;
+	test.name = "builtin-wrapped-index-store";
+	test.romData.assign(wrappedStore, wrappedStore + sizeof(wrappedStore));
+	test.instructionsPerFrame = 13;
+	for (unsigned int frame = 1; frame <= 10; ++frame)
+	{
+		// Nothing is drawn, the engines are compared on the whole machine state
+		Checkpoint checkpoint;
+		checkpoint.frame = frame;
+		checkpoint.hash = 0xD80AC658736BB725ull;
+		test.checkpoints.push_back(checkpoint);
+	}
+	tests.push_back(test);
+}
+
+static bool readPBM(const std::string& path, std::vector<uint8_t>& pixels)
+{
+	std::ifstream file(path);
+	std::string magic;
+	unsigned int width = 0, height = 0;
+	if (!file || !(file >> magic >> width >> height) || magic != "P1" || width != DISPLAY_WIDTH || height != DISPLAY_HEIGHT)
+	{
+		return false;
+	}
+
+	pixels.assign(DISPLAY_WIDTH * DISPLAY_HEIGHT, 0);
+	for (uint8_t& pixel : pixels)
+	{
+		int value = 0;
+		if (!(file >> value))
+		{
+			return false;
+		}
+		pixel = static_cast<uint8_t>(value != 0);
+	}
+	return true;
+}
+
+static void writeImages(const ConformanceCase& test, const Chip8& chip8, const std::string& tag, unsigned int frame, const std::string& outputDir)
+{
+	std::string base = outputDir + "/" + test.name + tag + ".frame" + std::to_string(frame);
+
+	std::ofstream actual(base + ".actual.pbm");
+	actual << "P1\n" << DISPLAY_WIDTH << " " << DISPLAY_HEIGHT << "\n";
+	for (unsigned int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; ++i)
+	{
+		actual << (chip8.display[i] ? '1' : '0') << ((i + 1) % DISPLAY_WIDTH ? ' ' : '\n');
+	}
+
+	std::string romDir = test.romPath.substr(0, test.romPath.find_last_of('/') + 1);
+	std::vector<uint8_t> golden;
+	if (!readPBM(romDir + test.name + tag + ".frame" + std::to_string(frame) + ".pbm", golden))
+	{
+		return;
+	}
+
+	std::ofstream diff(base + ".diff.ppm");
+	diff << "P3\n" << DISPLAY_WIDTH << " " << DISPLAY_HEIGHT << "\n255\n";
+	for (unsigned int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; ++i)
+	{
+		bool expected = golden[i] != 0;
+		bool got = chip8.display[i] != 0;
+		if (expected && got)
+			diff << "255 255 255\n";
+		else if (expected)
+			diff << "255 0 0\n";
+		else if (got)
+			diff << "0 255 0\n";
+		else
+			diff << "0 0 0\n";
+	}
+}
+
+// Runs the case on one engine, sampling the hashes at each checkpoint. Returns false with
+// error set if the engine cannot run this ROM.
+static bool runEngine(const ConformanceCase& test, Engine engine, const std::vector<Checkpoint>& checkpoints,
+	const std::string& outputDir, EngineRun& run, std::string& error)
+{
+	std::vector<uint8_t> rom = test.romData;
+	bool readable = !rom.empty();
+	if (!readable)
+	{
+		std::ifstream file(test.romPath, std::ios::binary);
+		rom.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		readable = static_cast<bool>(file);
+	}
+
+	Chip8 chip8;
+	if (!readable || !chip8.loadROM(rom.data(), rom.size()))
+	{
+		error = "cannot load ROM";
+		return false;
+	}
+	chip8.quirks = test.quirks;
+	chip8.timingMode = engine == ENGINE_VIP ? TIMING_COSMAC_VIP : test.timingMode;
+
+	AotModule aot;
+	if (engine == ENGINE_FUSED)
+	{
+		// Without a cache, so the output directory only holds images and nothing stale is reused
+		Analyzer analyzer;
+		analyzer.analyze(chip8, "");
+		fuseSuperinstructions(chip8, analyzer);
+	}
+	else if (engine == ENGINE_AOT)
+	{
+		if (test.romPath.empty())
+		{
+			return false;
+		}
+		std::string modulePath = test.romPath + ".so";
+		struct stat info;
+		if (stat(modulePath.c_str(), &info) != 0)
+		{
+			return false;
+		}
+		if (!aot.load(modulePath.c_str(), chip8))
+		{
+			error = "cannot load " + modulePath;
+			return false;
+		}
+	}
+
+	unsigned int lastFrame = checkpoints.empty() ? 0 : checkpoints.back().frame;
+	size_t nextInput = 0;
+	size_t nextCheckpoint = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int frame = 0; frame <= lastFrame; ++frame)
+	{
+		while (nextInput < test.inputs.size() && test.inputs[nextInput].frame == frame)
+		{
+			chip8.keypad[test.inputs[nextInput].key] = test.inputs[nextInput].pressed;
+			++nextInput;
+		}
+
+		while (nextCheckpoint < checkpoints.size() && checkpoints[nextCheckpoint].frame == frame)
+		{
+			run.framebufferHashes.push_back(framebufferHash(chip8));
+			run.stateHashes.push_back(chip8.stateHash());
+			if ((engine == ENGINE_INTERPRETER || engine == ENGINE_VIP) && run.framebufferHashes.back() != checkpoints[nextCheckpoint].hash)
+			{
+				writeImages(test, chip8, engine == ENGINE_VIP ? ".vip" : "", frame, outputDir);
+			}
+			++nextCheckpoint;
+		}
+
+		if (frame == lastFrame)
+		{
+			break;
+		}
+		if (aot.isLoaded() && chip8.timingMode == TIMING_FIXED_RATE)
+		{
+			unsigned int executed = 0;
+			while (executed < test.instructionsPerFrame)
+			{
+				executed += aot.step(chip8, test.instructionsPerFrame - executed);
+			}
+			run.instructions += executed;
+		}
+		else
+		{
+			run.instructions += chip8.runFrame(test.instructionsPerFrame);
+		}
+	}
+	run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	run.ran = true;
+	return true;
+}
+
+static ConformanceResult runCase(const ConformanceCase& test, const bool* engines, double minMips, const std::string& outputDir)
+{
+	ConformanceResult result;
+
+	for (int engine = 0; engine < ENGINE_COUNT; ++engine)
+	{
+		if (!engines[engine] || (engine == ENGINE_VIP && test.vipCheckpoints.empty()))
+		{
+			continue;
+		}
+
+		const std::vector<Checkpoint>& checkpoints = engine == ENGINE_VIP ? test.vipCheckpoints : test.checkpoints;
+		EngineRun& run = result.engines[engine];
+		std::string error;
+		if (!runEngine(test, static_cast<Engine>(engine), checkpoints, outputDir, run, error))
+		{
+			if (!error.empty())
+			{
+				result.failures.push_back(std::string(ENGINE_NAMES[engine]) + ": " + error);
+			}
+			continue;
+		}
+
+		// Other engines must behave exactly like the interpreter, the whole machine state included
+		const EngineRun& interpreter = result.engines[ENGINE_INTERPRETER];
+		bool golden = engine == ENGINE_INTERPRETER || engine == ENGINE_VIP || !interpreter.ran;
+		for (size_t i = 0; i < checkpoints.size(); ++i)
+		{
+			char message[128];
+			if (golden)
+			{
+				if (run.framebufferHashes[i] == checkpoints[i].hash)
+				{
+					continue;
+				}
+				snprintf(message, sizeof(message), "%s: frame %u: expected %016llx, got %016llx", ENGINE_NAMES[engine],
+					checkpoints[i].frame, static_cast<unsigned long long>(checkpoints[i].hash),
+					static_cast<unsigned long long>(run.framebufferHashes[i]));
+				result.failures.push_back(message);
+			}
+			else if (run.framebufferHashes[i] != interpreter.framebufferHashes[i] || run.stateHashes[i] != interpreter.stateHashes[i])
+			{
+				snprintf(message, sizeof(message), "%s: frame %u: state %016llx differs from the interpreter's %016llx",
+					ENGINE_NAMES[engine], checkpoints[i].frame, static_cast<unsigned long long>(run.stateHashes[i]),
+					static_cast<unsigned long long>(interpreter.stateHashes[i]));
+				result.failures.push_back(message);
+				// Everything after the first divergence differs too
+				break;
+			}
+		}
+
+		double minimum = test.minMips > 0.0 ? test.minMips : minMips;
+		double mips = run.seconds > 0.0 ? run.instructions / run.seconds / 1e6 : 0.0;
+		if (minimum > 0.0 && run.instructions > 0 && mips < minimum)
+		{
+			char message[128];
+			snprintf(message, sizeof(message), "%s: %.2f M instr/s, below the minimum of %.2f", ENGINE_NAMES[engine], mips, minimum);
+			result.failures.push_back(message);
+		}
+	}
+
+	result.passed = result.failures.empty();
+	return result;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: " << argv[0] << " <ROM Directory> [--jobs <N>] [--out <Directory>] [--engines <List>] [--min-mips <N>]\n"
+			<< "  --engines <List>   Comma-separated engines to run (default interpreter,fused,aot,vip)\n"
+			<< "  --min-mips <N>     Minimum throughput for ROMs without a min-mips directive (default none)\n";
+		return 2;
+	}
+
+	std::string romDir = argv[1];
+	std::string outputDir = "conformance-out";
+	unsigned int jobs = std::max(1u, std::thread::hardware_concurrency());
+	bool engines[ENGINE_COUNT] = { true, true, true, true };
+	double minMips = 0.0;
+
+	for (int i = 2; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+		{
+			jobs = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+		{
+			outputDir = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--engines") == 0 && i + 1 < argc)
+		{
+			std::fill(engines, engines + ENGINE_COUNT, false);
+			std::istringstream list(argv[++i]);
+			std::string name;
+			while (std::getline(list, name, ','))
+			{
+				const char* const* found = std::find(ENGINE_NAMES, ENGINE_NAMES + ENGINE_COUNT, name);
+				if (found == ENGINE_NAMES + ENGINE_COUNT)
+				{
+					std::cerr << "Unknown engine: " << name << std::endl;
+					return 2;
+				}
+				engines[found - ENGINE_NAMES] = true;
+			}
+		}
+		else if (std::strcmp(argv[i], "--min-mips") == 0 && i + 1 < argc)
+		{
+			minMips = std::atof(argv[++i]);
+		}
+		else
+		{
+			std::cerr << "Unknown option: " << argv[i] << std::endl;
+			return 2;
+		}
+	}
+
+	// Every `name.expect` describes the ROM `name` in the same directory
+	std::vector<ConformanceCase> tests;
+	std::vector<std::string> errors;
+	DIR* dir = opendir(romDir.c_str());
+	if (!dir)
+	{
+		std::cerr << "Error: Failed to open directory: " << romDir << std::endl;
+		return 2;
+	}
+	while (dirent* entry = readdir(dir))
+	{
+		std::string fileName = entry->d_name;
+		const std::string suffix = ".expect";
+		if (fileName.size() <= suffix.size() || fileName.compare(fileName.size() - suffix.size(), suffix.size(), suffix) != 0)
+		{
+			continue;
+		}
+
+		ConformanceCase test;
+		test.name = fileName.substr(0, fileName.size() - suffix.size());
+		test.romPath = romDir + "/" + test.name;
+
+		std::string error;
+		if (parseExpectations(romDir + "/" + fileName, test, error))
+			tests.push_back(test);
+		else
+			errors.push_back(error);
+	}
+	closedir(dir);
+	addBuiltinCases(tests);
+
+	std::sort(tests.begin(), tests.end(), [](const ConformanceCase& a, const ConformanceCase& b) { return a.name < b.name; });
+	mkdir(outputDir.c_str(), 0755);
+
+	std::vector<ConformanceResult> results(tests.size());
+	std::atomic<size_t> nextTest(0);
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < std::min<size_t>(jobs, tests.size()); ++i)
+	{
+		workers.emplace_back([&]()
+		{
+			for (size_t t = nextTest++; t < tests.size(); t = nextTest++)
+			{
+				results[t] = runCase(tests[t], engines, minMips, outputDir);
+			}
+		});
+	}
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+
+	unsigned int failed = 0;
+	for (size_t t = 0; t < tests.size(); ++t)
+	{
+		const ConformanceResult& result = results[t];
+		printf("%-4s %s\n", result.passed ? "PASS" : "FAIL", tests[t].name.c_str());
+		for (int engine = 0; engine < ENGINE_COUNT; ++engine)
+		{
+			const EngineRun& run = result.engines[engine];
+			if (run.ran)
+			{
+				double mips = run.seconds > 0.0 ? run.instructions / run.seconds / 1e6 : 0.0;
+				printf("       %-27s %10llu instr  %8.2f M instr/s\n", ENGINE_NAMES[engine],
+					static_cast<unsigned long long>(run.instructions), mips);
+			}
+		}
+
+		if (!result.error.empty())
+		{
+			printf("       %s\n", result.error.c_str());
+		}
+		for (const std::string& failure : result.failures)
+		{
+			printf("       %s\n", failure.c_str());
+		}
+		failed += result.passed ? 0 : 1;
+	}
+	for (const std::string& error : errors)
+	{
+		printf("ERROR %s\n", error.c_str());
+	}
+
+	printf("%zu passed, %u failed\n", tests.size() - failed, failed);
+	return (failed || !errors.empty()) ? 1 : 0;
+}
@@ -0,0 +1,229 @@
+// Compiles a ROM ahead of time into C++ with one function per basic block found by the Analyzer.
+// Build the output as a shared library and pass it to the emulator with --aot:
+//   c++ -O2 -shared -fPIC -I src rom.cpp -o rom.so
+//
+// Simple register, timer and branch instructions are inlined; everything else calls back into the
+// interpreter's decoder, so the compiled code behaves exactly like Chip8::emulateCycle() in
+// TIMING_FIXED_RATE.
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "Chip8.h"
+#include "Analyzer.h"
+#include "AotModule.h"
+#include "Disassembler.h"
+
+static std::string hex(unsigned int value, int digits)
+{
+	char text[16];
+	snprintf(text, sizeof(text), "0x%0*X", digits, value);
+	return text;
+}
+
+// Straight-line C++ for opcode, or an empty string if it needs the interpreter. Statements follow the
+// order of the matching Chip8::OP_* handler so VF comes out the same when X or Y is F.
+static std::string inlineOpcode(uint16_t opcode)
+{
+	std::string vx = "c.registers[" + hex((opcode >> 8u) & 0x0Fu, 1) + "]";
+	std::string vy = "c.registers[" + hex((opcode >> 4u) & 0x0Fu, 1) + "]";
+	std::string nn = hex(opcode & 0x00FFu, 2);
+	const std::string vf = "c.registers[0xF]";
+
+	switch (opcode & 0xF000u)
+	{
+	case 0x6000u:
+		return vx + " = " + nn + ";";
+	case 0x7000u:
+		return vx + " += " + nn + ";";
+	case 0xA000u:
+		return "c.indexRegister = " + hex(opcode & 0x0FFFu, 3) + ";";
+	case 0x8000u:
+		switch (opcode & 0x000Fu)
+		{
+		case 0x0u:
+			return vx + " = " + vy + ";";
+		case 0x1u:
+			return vx + " |= " + vy + ";";
+		case 0x2u:
+			return vx + " &= " + vy + ";";
+		case 0x3u:
+			return vx + " ^= " + vy + ";";
+		case 0x4u:
+			return "{ uint16_t sum = " + vx + " + " + vy + "; " + vf + " = sum > 255; " + vx + " = sum & 0xFFu; }";
+		case 0x5u:
+			return vf + " = " + vx + " >= " + vy + "; " + vx + " -= " + vy + ";";
+		case 0x6u:
+			return vf + " = " + vy + " & 0x1u; " + vx + " = " + vy + " >> 1;";
+		case 0x7u:
+			return vf + " = " + vy + " > " + vx + "; " + vx + " = " + vy + " - " + vx + ";";
+		case 0xEu:
+			return vf + " = (" + vx + " >> 7u) & 0x1u; " + vx + " <<= 1;";
+		default:
+			return "";
+		}
+	case 0xF000u:
+		switch (opcode & 0x00FFu)
+		{
+		case 0x07u:
+			return vx + " = c.delayTimer;";
+		case 0x15u:
+			return "c.delayTimer = " + vx + ";";
+		case 0x18u:
+			return "c.soundTimer = " + vx + ";";
+		case 0x1Eu:
+			return "c.indexRegister += " + vx + ";";
+		case 0x29u:
+			return "c.indexRegister = FONTSET_START_ADDRESS + 5 * " + vx + ";";
+		default:
+			return "";
+		}
+	default:
+		return "";
+	}
+}
+
+// Condition under which a skip instruction skips, or an empty string
+static std::string skipCondition(uint16_t opcode)
+{
+	std::string vx = "c.registers[" + hex((opcode >> 8u) & 0x0Fu, 1) + "]";
+	std::string vy = "c.registers[" + hex((opcode >> 4u) & 0x0Fu, 1) + "]";
+	std::string nn = hex(opcode & 0x00FFu, 2);
+
+	switch (opcode & 0xF000u)
+	{
+	case 0x3000u:
+		return vx + " == " + nn;
+	case 0x4000u:
+		return vx + " != " + nn;
+	case 0x5000u:
+		return (opcode & 0x000Fu) == 0 ? vx + " == " + vy : "";
+	case 0x9000u:
+		return (opcode & 0x000Fu) == 0 ? vx + " != " + vy : "";
+	default:
+		return "";
+	}
+}
+
+static void emitBlock(std::ostream& out, const Chip8& chip8, const BasicBlock& block)
+{
+	out << "static uint32_t block_" << hex(block.start, 3).substr(2) << "(Chip8& c, AotExecuteFunction execute)\n{\n";
+
+	unsigned int retired = 0;
+	for (uint16_t address = block.start; address < block.end; address += 2)
+	{
+		uint16_t opcode = chip8.memory[address] << 8u | chip8.memory[address + 1];
+		uint16_t next = address + 2;
+		bool last = next >= block.end;
+		++retired;
+
+		out << "\t// " << hex(address, 3) << ": " << hex(opcode, 4).substr(2) << "  " << disassembleOpcode(opcode) << "\n";
+
+		std::string code = inlineOpcode(opcode);
+		std::string condition = skipCondition(opcode);
+		bool callback = false;
+		if (!code.empty())
+		{
+			out << "\t" << code << "\n";
+			if (last)
+			{
+				out << "\tc.pc = " << hex(next, 3) << ";\n";
+			}
+		}
+		else if (!condition.empty())
+		{
+			out << "\tc.pc = (" << condition << ") ? " << hex(next + 2, 3) << " : " << hex(next, 3) << ";\n";
+		}
+		else if ((opcode & 0xF000u) == 0x1000u)
+		{
+			out << "\tc.pc = " << hex(opcode & 0x0FFFu, 3) << ";\n";
+		}
+		else
+		{
+			out << "\tc.pc = " << hex(next, 3) << ";\n";
+			out << "\texecute(c, " << hex(opcode, 4) << ");\n";
+			callback = true;
+		}
+
+		out << "\ttick(c);\n";
+		if (last)
+		{
+			out << "\tc.opcode = " << hex(opcode, 4) << ";\n";
+			out << "\treturn " << retired << ";\n";
+		}
+		else if (callback)
+		{
+			// The interpreter may have stopped the machine, modified compiled code or waited on a key
+			out << "\tif (c.runState != RUN_RUNNING || c.codeModified || c.pc != " << hex(next, 3) << ")\n";
+			out << "\t\treturn " << retired << ";\n";
+		}
+	}
+	out << "}\n\n";
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		std::cerr << "Usage: " << argv[0] << " <ROM> <Output.cpp>\n";
+		return 2;
+	}
+
+	static Chip8 chip8;
+	if (!chip8.loadROM(argv[1]))
+	{
+		return 1;
+	}
+
+	Analyzer analyzer;
+	analyzer.analyze(chip8, ".chip8cache");
+
+	std::ofstream out(argv[2]);
+	if (!out)
+	{
+		std::cerr << "Error: Failed to open output file: " << argv[2] << std::endl;
+		return 1;
+	}
+
+	out << "// Generated by Chip8Recompile from " << argv[1] << ", do not edit\n";
+	out << "#include \"AotModule.h\"\n\n";
+	out << "// What Chip8::emulateCycle() does after every instruction in TIMING_FIXED_RATE\n";
+	out << "static inline void tick(Chip8& c)\n{\n";
+	out << "\tc.delayTimer -= c.delayTimer != 0;\n";
+	out << "\tc.soundTimer -= c.soundTimer != 0;\n";
+	out << "\t++c.cycleCount;\n";
+	out << "}\n\n";
+
+	for (const BasicBlock& block : analyzer.blocks)
+	{
+		emitBlock(out, chip8, block);
+	}
+
+	out << "extern \"C\" const uint32_t chip8AotAbiVersion = " << AOT_ABI_VERSION << ";\n";
+	out << "extern \"C\" const uint32_t chip8AotChip8Size = sizeof(Chip8);\n";
+	out << "extern \"C\" const uint64_t chip8AotRomHash = " << "0x" << std::hex << analyzer.romHash << std::dec << "ull;\n";
+	out << "extern \"C\" const uint32_t chip8AotBlockCount = " << analyzer.blocks.size() << ";\n";
+	out << "extern \"C\" const AotBlock chip8AotBlocks[] =\n{\n";
+	for (const BasicBlock& block : analyzer.blocks)
+	{
+		out << "\t{ " << hex(block.start, 3) << ", " << (block.end - block.start) / 2 << ", &block_" << hex(block.start, 3).substr(2) << " },\n";
+	}
+	if (analyzer.blocks.empty())
+	{
+		out << "\t{ 0, 0, nullptr },\n";
+	}
+	out << "};\n";
+
+	if (!out)
+	{
+		std::cerr << "Error: Failed to write output file: " << argv[2] << std::endl;
+		return 1;
+	}
+
+	std::cout << "Compiled " << analyzer.blocks.size() << " blocks to " << argv[2] << "\n";
+	std::cout << "Build with: c++ -O2 -shared -fPIC -I src " << argv[2] << " -o <ROM>.so" << std::endl;
+	return 0;
+}
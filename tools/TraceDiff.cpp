@@ -0,0 +1,141 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "TraceRecorder.h"
+#include "Disassembler.h"
+
+// Loads a trace file and returns its records from oldest to newest
+static bool loadTrace(const char* fileName, std::vector<TraceRecord>& records)
+{
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+	if (!file)
+	{
+		std::cerr << "Error: Failed to open trace file: " << fileName << std::endl;
+		return false;
+	}
+	uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+	file.seekg(0);
+
+	TraceHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.magic != TRACE_MAGIC || header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord))
+	{
+		std::cerr << "Error: Not a trace file: " << fileName << std::endl;
+		return false;
+	}
+
+	// The capacity sizes the ring buffer below and masks every index, so it has to describe this very file
+	uint64_t expectedSize = sizeof(TraceHeader) + static_cast<uint64_t>(header.capacity) * sizeof(TraceRecord);
+	bool powerOfTwo = header.capacity != 0 && (header.capacity & (header.capacity - 1)) == 0;
+	if (!powerOfTwo || header.capacity > TRACE_MAX_CAPACITY || fileSize != expectedSize)
+	{
+		std::cerr << "Error: Corrupt trace header, capacity " << header.capacity << " does not match the file size: " << fileName << std::endl;
+		return false;
+	}
+
+	std::vector<TraceRecord> ring(header.capacity);
+	file.read(reinterpret_cast<char*>(ring.data()), ring.size() * sizeof(TraceRecord));
+	if (!file)
+	{
+		std::cerr << "Error: Truncated trace file: " << fileName << std::endl;
+		return false;
+	}
+
+	// Once the ring has wrapped the oldest record sits right after the newest one
+	uint64_t available = header.count < header.capacity ? header.count : header.capacity;
+	uint64_t oldest = header.count - available;
+	records.resize(available);
+	for (uint64_t i = 0; i < available; ++i)
+	{
+		records[i] = ring[(oldest + i) & (header.capacity - 1)];
+	}
+
+	return true;
+}
+
+static void printRecord(const char* label, const TraceRecord& record, const TraceRecord* previous)
+{
+	printf("%s cycle %llu  PC 0x%03X  %04X  %-16s I=0x%03X SP=%u DT=%u ST=%u\n", label,
+		static_cast<unsigned long long>(record.cycle), record.pc,
+		record.opcode, disassembleOpcode(record.opcode).c_str(), record.indexRegister, record.sp, record.delayTimer, record.soundTimer);
+
+	printf("%s   ", label);
+	for (int i = 0; i < 16; ++i)
+	{
+		bool changed = previous && previous->registers[i] != record.registers[i];
+		printf(" V%X=%02X%s", i, record.registers[i], changed ? "*" : "");
+	}
+	if (record.memoryLength)
+	{
+		printf("  wrote [0x%03X..0x%03X]", record.memoryAddress, record.memoryAddress + record.memoryLength - 1);
+	}
+	printf("\n");
+}
+
+static bool sameRecord(const TraceRecord& a, const TraceRecord& b)
+{
+	return a.pc == b.pc && a.opcode == b.opcode && a.indexRegister == b.indexRegister &&
+		a.sp == b.sp && a.delayTimer == b.delayTimer && a.soundTimer == b.soundTimer &&
+		a.memoryLength == b.memoryLength && (a.memoryLength == 0 || a.memoryAddress == b.memoryAddress) &&
+		memcmp(a.registers, b.registers, sizeof(a.registers)) == 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc != 3)
+	{
+		std::cerr << "Usage: " << argv[0] << " <Trace A> <Trace B>\n";
+		return 2;
+	}
+
+	std::vector<TraceRecord> traceA, traceB;
+	if (!loadTrace(argv[1], traceA) || !loadTrace(argv[2], traceB))
+	{
+		return 2;
+	}
+	if (traceA.empty() || traceB.empty())
+	{
+		std::cerr << "Error: Empty trace" << std::endl;
+		return 2;
+	}
+
+	// Align both traces on the first cycle they both still hold
+	size_t a = 0, b = 0;
+	while (a < traceA.size() && traceA[a].cycle < traceB[0].cycle) ++a;
+	while (b < traceB.size() && traceB[b].cycle < traceA[0].cycle) ++b;
+
+	if (a == traceA.size() || b == traceB.size())
+	{
+		std::cerr << "Error: The traces cover disjoint cycle ranges" << std::endl;
+		return 2;
+	}
+
+	size_t compared = 0;
+	for (; a < traceA.size() && b < traceB.size(); ++a, ++b, ++compared)
+	{
+		if (traceA[a].cycle != traceB[b].cycle || !sameRecord(traceA[a], traceB[b]))
+		{
+			printf("First divergence after %zu matching instructions:\n", compared);
+			if (a > 0 && b > 0)
+			{
+				printRecord("  =", traceA[a - 1], nullptr);
+			}
+			printRecord("  A", traceA[a], a > 0 ? &traceA[a - 1] : nullptr);
+			printRecord("  B", traceB[b], b > 0 ? &traceB[b - 1] : nullptr);
+			return 1;
+		}
+	}
+
+	if (a < traceA.size() || b < traceB.size())
+	{
+		printf("No divergence in %zu instructions, %s continues for %zu more\n", compared,
+			a < traceA.size() ? argv[1] : argv[2], a < traceA.size() ? traceA.size() - a : traceB.size() - b);
+		return 0;
+	}
+
+	printf("Traces are identical (%zu instructions)\n", compared);
+	return 0;
+}